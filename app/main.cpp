@@ -6,6 +6,7 @@
 #include <dbLevelDbIndex.hpp>
 #include <dbLevelDbFullScan.hpp>
 #include <dbAdaptiveMergingIndex.hpp>
+#include <dbSecondaryKeyFilter.hpp>
 
 #include <filesystem>
 #include <chrono>
@@ -514,5 +515,11 @@ int main()
     // dbLevelDbFullScanExample();
     dbAdaptiveMergingExample();
 
+    if (!DBSecondaryKeyFilter::checkKernels())
+        return 1;
+
+    if (!DBBenchmark::indexesResultsCheck(2 * 1000, 16, 50) || !DBBenchmark::indexesResultsCheck(2 * 1000, 16, 50, true))
+        return 1;
+
     return 0;
 }
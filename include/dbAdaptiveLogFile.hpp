@@ -0,0 +1,271 @@
+#ifndef DB_ADAPTIVE_LOG_FILE_HPP
+#define DB_ADAPTIVE_LOG_FILE_HPP
+
+#include <dbRecord.hpp>
+#include <dbIndexCursor.hpp>
+#include <dbSecondaryKeyFilter.hpp>
+#include <logger.hpp>
+
+#include <leveldb/slice.h>
+#include <leveldb/filter_policy.h>
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <cstdint>
+
+// Binary AL file (.alf) layout, all integers are fixed size little endian (see DBCoding):
+//
+// [data block 0] ... [data block N - 1] [footer] [trailer]
+//
+// data block: records (keySize32 | valSize32 | key | val) ... | keyColumn | crc32c32 of records and keyColumn
+//             block is closed when next record would not fit into blockSize (oversized record gets own block)
+//             keyColumn: keys of all block records stored one after another, written only when all keys have 8 bytes
+//             (secondary keys), so range probe can filter whole block by SIMD kernel (see DBSecondaryKeyFilter)
+// footer:     version32 | sorted8 | numRecords64 | minKey (size32 | key) | maxKey (size32 | key) | numBlocks32 |
+//             numBlocks * (offset64 | size32 | keyColumnSize32 | firstRecordIndex64 | fenceKey (size32 | key)) | filter (size32 | bloom) | crc32c32 of footer
+// trailer:    footerOffset64 | footerSize32 | magic32
+//
+// AL files are sorted runs: records are appended in key order and fenceKey is the first key of the block,
+// so range probe can binary search the first block and stop on the first key greater than maxKey.
+// Bloom filter over all keys of the file lets point probes skip files without the key.
+class DBAdaptiveLogFile
+{
+public:
+    static constexpr uint32_t formatVersion = 4;
+    static constexpr uint32_t magic = 0x414C4631; // "ALF1"
+    static constexpr size_t defaultBlockSize = 4 * 1024;
+    static constexpr size_t trailerSize = sizeof(uint64_t) + sizeof(uint32_t) + sizeof(uint32_t);
+    static constexpr int bloomBitsPerKey = 10;
+
+    static const leveldb::FilterPolicy* getFilterPolicy() noexcept(true);
+
+    // false only when key is surely not in the file, empty filter can match everything
+    static bool keyMayMatch(const std::string& filter, const leveldb::Slice& key) noexcept(true);
+
+    struct DBAdaptiveLogFileBlockHandle
+    {
+        uint64_t offset;
+        uint32_t size; // records only, without keyColumn and crc
+        uint32_t keyColumnSize; // 0 when block has no keyColumn
+        uint64_t firstRecordIndex;
+        std::string fenceKey; // first key in the block
+    };
+};
+
+class DBAdaptiveLogFileWriter
+{
+private:
+    std::string filePath;
+    size_t blockSize;
+    std::ofstream file;
+
+    std::string block;
+    std::string blockKeyColumn;
+    bool blockHasKeyColumn;
+    std::string blockFenceKey;
+    uint64_t blockFirstRecordIndex;
+    uint64_t fileOffset;
+    std::vector<DBAdaptiveLogFile::DBAdaptiveLogFileBlockHandle> blocks;
+
+    // keys are kept in one buffer until finish builds the filter
+    std::string filterKeys;
+    std::vector<size_t> filterKeyOffsets;
+    std::string filter;
+
+    size_t numRecords;
+    std::string minKey;
+    std::string maxKey;
+    bool sorted;
+    bool finished;
+
+    void flushBlock() noexcept(true);
+
+public:
+    // records should be appended in key order, otherwise file is marked as unsorted and range probes scan whole file
+    void append(const leveldb::Slice& key, const leveldb::Slice& val) noexcept(true);
+
+    void append(const DBRecord& r) noexcept(true)
+    {
+        append(r.getKey(), r.getVal());
+    }
+
+    // write footer and close the file, returns false on IO error
+    bool finish() noexcept(true);
+
+    size_t getNumRecords() const noexcept(true)
+    {
+        return numRecords;
+    }
+
+    const std::string& getMinKey() const noexcept(true)
+    {
+        return minKey;
+    }
+
+    const std::string& getMaxKey() const noexcept(true)
+    {
+        return maxKey;
+    }
+
+    // valid after finish
+    const std::string& getFilter() const noexcept(true)
+    {
+        return filter;
+    }
+
+    DBAdaptiveLogFileWriter(const std::string& filePath, size_t blockSize = DBAdaptiveLogFile::defaultBlockSize)
+    : filePath{filePath}, blockSize{blockSize}, file{filePath, std::ios::binary | std::ios::trunc}, blockHasKeyColumn{true}, blockFirstRecordIndex{0}, fileOffset{0}, numRecords{0}, sorted{true}, finished{false}
+    {
+        LOGGER_LOG_TRACE("DBAdaptiveLogFileWriter created, file: {}, blockSize: {}", filePath, blockSize);
+    }
+
+    virtual ~DBAdaptiveLogFileWriter() noexcept(true)
+    {
+        if (!finished)
+            finish();
+    }
+
+    DBAdaptiveLogFileWriter() = delete;
+    DBAdaptiveLogFileWriter(const DBAdaptiveLogFileWriter&) = delete;
+    DBAdaptiveLogFileWriter(DBAdaptiveLogFileWriter&&) = delete;
+    DBAdaptiveLogFileWriter& operator=(const DBAdaptiveLogFileWriter&) = delete;
+    DBAdaptiveLogFileWriter& operator=(DBAdaptiveLogFileWriter&&) = delete;
+};
+
+// Reader maps the whole AL file into memory, records are handed out as slices pointing into the mapping
+class DBAdaptiveLogFileReader
+{
+private:
+    friend class DBAdaptiveLogFileCursor;
+
+    std::string filePath;
+    const char* fileData;
+    size_t fileSize;
+    bool mapped;
+    std::string fileBuffer; // used only when file cannot be mapped
+    bool valid;
+
+    bool sorted;
+    uint64_t numRecords;
+    std::string minKey;
+    std::string maxKey;
+    std::vector<DBAdaptiveLogFile::DBAdaptiveLogFileBlockHandle> blocks;
+    std::string filter;
+
+    bool readFooter() noexcept(true);
+    // with keyFilter records are filtered by block keyColumn first, so f gets only records selected by the filter
+    bool forEachRecordInBlock(size_t blockIndex, const std::function<bool(size_t, const leveldb::Slice&, const leveldb::Slice&)>& f, const DBSecondaryKeyFilter* keyFilter = nullptr) const noexcept(true);
+
+public:
+    // f(recordIndex, key, val), slices point into the mapped file and are valid only inside f
+    using RecordCallback = std::function<void(size_t, const leveldb::Slice&, const leveldb::Slice&)>;
+
+    // iterate over all records in file order, returns false if file is corrupted
+    bool forEachRecord(const RecordCallback& f) const noexcept(true);
+
+    // iterate over records with key in range <minKey, maxKey>, only blocks overlapping the range are read
+    bool forEachRecordInRange(const leveldb::Slice& minKey, const leveldb::Slice& maxKey, const RecordCallback& f) const noexcept(true);
+
+    // get key of recordIndex-th record, reads only block with this record
+    bool getKey(size_t recordIndex, std::string& key) const noexcept(true);
+
+    bool isSorted() const noexcept(true)
+    {
+        return sorted;
+    }
+
+    bool isValid() const noexcept(true)
+    {
+        return valid;
+    }
+
+    size_t getNumRecords() const noexcept(true)
+    {
+        return numRecords;
+    }
+
+    const std::string& getMinKey() const noexcept(true)
+    {
+        return minKey;
+    }
+
+    const std::string& getMaxKey() const noexcept(true)
+    {
+        return maxKey;
+    }
+
+    const std::string& getFilter() const noexcept(true)
+    {
+        return filter;
+    }
+
+    explicit DBAdaptiveLogFileReader(const std::string& filePath);
+
+    virtual ~DBAdaptiveLogFileReader() noexcept(true);
+
+    DBAdaptiveLogFileReader() = delete;
+    DBAdaptiveLogFileReader(const DBAdaptiveLogFileReader&) = delete;
+    DBAdaptiveLogFileReader(DBAdaptiveLogFileReader&&) = delete;
+    DBAdaptiveLogFileReader& operator=(const DBAdaptiveLogFileReader&) = delete;
+    DBAdaptiveLogFileReader& operator=(DBAdaptiveLogFileReader&&) = delete;
+};
+
+// Cursor over untouched records of the AL file, only one block is decoded at a time.
+// Reader is shared, so the mapping stays valid when the file is rewritten or removed under the cursor.
+class DBAdaptiveLogFileCursor : public DBIndexCursor
+{
+private:
+    std::shared_ptr<const DBAdaptiveLogFileReader> alFile;
+    std::vector<uint8_t> touchedEntries; // snapshot, touched records are skipped, empty means nothing touched
+
+    // untouched records of the current block, whole file for unsorted file (it has no usable fences)
+    std::vector<std::pair<leveldb::Slice, leveldb::Slice>> records;
+    size_t nextBlock;
+    size_t pos;
+
+    void loadNextBlock() noexcept(true);
+    void loadAllBlocks() noexcept(true);
+
+public:
+    bool isValid() const noexcept(true) override
+    {
+        return pos < records.size();
+    }
+
+    void seekToFirst() noexcept(true) override;
+    void seek(const leveldb::Slice& key) noexcept(true) override;
+    void next() noexcept(true) override;
+
+    leveldb::Slice getKey() const noexcept(true) override
+    {
+        return records[pos].first;
+    }
+
+    leveldb::Slice getVal() const noexcept(true) override
+    {
+        return records[pos].second;
+    }
+
+    DBAdaptiveLogFileCursor(const std::shared_ptr<const DBAdaptiveLogFileReader>& alFile, const std::vector<uint8_t>& touchedEntries)
+    : alFile{alFile}, touchedEntries{touchedEntries}, nextBlock{0}, pos{0}
+    {
+        if (!alFile->isSorted())
+            loadAllBlocks();
+
+        seekToFirst();
+    }
+
+    virtual ~DBAdaptiveLogFileCursor() noexcept(true) = default;
+
+    DBAdaptiveLogFileCursor() = delete;
+    DBAdaptiveLogFileCursor(const DBAdaptiveLogFileCursor&) = delete;
+    DBAdaptiveLogFileCursor(DBAdaptiveLogFileCursor&&) = delete;
+    DBAdaptiveLogFileCursor& operator=(const DBAdaptiveLogFileCursor&) = delete;
+    DBAdaptiveLogFileCursor& operator=(DBAdaptiveLogFileCursor&&) = delete;
+};
+
+#endif
@@ -4,14 +4,21 @@
 #include <dbIndex.hpp>
 #include <dbLevelDbIndex.hpp>
 #include <dbInMemoryIndex.hpp>
+#include <dbAdaptiveLogFile.hpp>
+#include <dbIntervalIndex.hpp>
 #include <logger.hpp>
 
 #include <string>
 #include <vector>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <future>
 #include <filesystem>
 #include <functional>
+#include <chrono>
 
 class DBAdaptiveMergingIndex : public DBIndex
 {
@@ -23,15 +30,22 @@ private:
         struct DBAdaptiveLogEntry
         {
         public:
+            size_t fileId;
             std::string filePath;
             std::string minKey;
             std::string maxKey;
             size_t numRecordsInFile;
             std::vector<uint8_t> touchedEntries; // can be bool, but since bool is packed has so much slower access
+            size_t numTouchedEntries;
             bool shouldBeDeleted;
+            std::string bloomFilter; // copy of the file filter, point probes check it before opening the file
 
-            DBAdaptiveLogEntry(const std::string& filePath, const std::string& minKey, const std::string& maxKey, size_t numRecordsInFile)
-            : filePath{filePath}, minKey{minKey}, maxKey{maxKey}, numRecordsInFile{numRecordsInFile}, shouldBeDeleted{false}
+            // guards the file and all fields above while AL is locked in shared mode
+            // copies share the mutex, entries are copied only when AL is locked exclusively
+            std::shared_ptr<std::mutex> entryMutex{std::make_shared<std::mutex>()};
+
+            DBAdaptiveLogEntry(size_t fileId, const std::string& filePath, const std::string& minKey, const std::string& maxKey, size_t numRecordsInFile)
+            : fileId{fileId}, filePath{filePath}, minKey{minKey}, maxKey{maxKey}, numRecordsInFile{numRecordsInFile}, numTouchedEntries{0}, shouldBeDeleted{false}
             {
                 touchedEntries.resize(numRecordsInFile);
                 std::fill(std::begin(touchedEntries), std::end(touchedEntries), 0); // untouched
@@ -48,30 +62,99 @@ private:
             DBAdaptiveLogEntry& operator=(DBAdaptiveLogEntry&&) noexcept(true) = default;
         };
 
+        // Locking: alMutex in shared mode for searches (entries are locked one by one),
+        // exclusive mode for changes of alFiles, alFilesIndex, ramBuffer and mergeBuffer pointers
+        std::shared_mutex alMutex;
+
         std::shared_ptr<DBLevelDbIndex> primaryIndex;
 
         std::unique_ptr<DBInMemoryIndex> ramBuffer;
         size_t ramBufferCapacity;
 
+        // records found by searches are moved here and wait for the merge into secondaryIndex
+        std::unique_ptr<DBInMemoryIndex> mergeBuffer;
+
+        // AL file is rewritten without touched records when fraction of untouched records drops below this value
+        double alRewriteThreshold;
+
         std::string alFolderPath;
-        size_t alRecordsNumber;
-        std::vector<DBAdaptiveMergingIndex::DBAdaptiveLog::DBAdaptiveLogEntry> alFiles;
+
+        // bytes of records held in memory by all tasks copying primaryIndex into AL
+        size_t alBuildMemoryBudget;
+
+        std::atomic<size_t> alRecordsNumber;
+        std::map<size_t, DBAdaptiveMergingIndex::DBAdaptiveLog::DBAdaptiveLogEntry> alFiles; // fileId -> entry, references stay valid on insert and erase
+        DBIntervalIndex alFilesIndex; // key ranges of alFiles, used to find files overlapping the query
         size_t newFileId;
 
-        void copyPrimIndexIntoAl() noexcept(true);
+        // AL metadata is persisted in the manifest, so reopen does not need to copy primaryIndex again
+        // manifest is replaced only by the next one, files it references are removed after that (see obsoleteAlFiles)
+        uint64_t manifestSequence;
+        bool restoredFromManifest;
+        bool restoredAfterCrash; // manifest was written while AL was in use, changes made after it are lost
+        size_t secIndexRecordsNumber; // last number given by the owner, valid only in manifest written on close
+
+        // primaryIndex content AL was copied from, restored AL is valid only for the same content
+        size_t primaryRecordsNumber;
+        uint64_t primaryChecksum;
+
+        // AL (and secondaryIndex) got inserts or deletes, so they cannot be rebuilt from primaryIndex
+        std::atomic<bool> ownRecords;
+
+        // ramBuffer was flushed to the file not referenced by the manifest yet
+        std::atomic<bool> checkpointNeeded;
+
+        // files replaced or emptied since the last manifest, they are removed when the new manifest is saved
+        std::mutex obsoleteAlFilesMutex;
+        std::vector<std::string> obsoleteAlFiles;
+
+        bool loadManifest() noexcept(true);
+        bool saveManifest(bool closed) noexcept(true);
+        void checkpoint(bool closed) noexcept(true);
+        void removeObsoleteAlFiles() noexcept(true);
+        void removeUnreferencedAlFiles() noexcept(true);
+        void removeAllAlFiles() noexcept(true);
+        void addAlFile(const DBAdaptiveMergingIndex::DBAdaptiveLog::DBAdaptiveLogEntry& alLog) noexcept(true);
+        void updateAlFilesIndex(const std::vector<size_t>& fileIds) noexcept(true);
+
+        static void updateAlLogEntryKeyRange(DBAdaptiveMergingIndex::DBAdaptiveLog::DBAdaptiveLogEntry& alLog, const DBAdaptiveLogFileReader& alFile) noexcept(true);
+
+        void rewriteAlFile(DBAdaptiveMergingIndex::DBAdaptiveLog::DBAdaptiveLogEntry& alLog, const DBAdaptiveLogFileReader& alFile) noexcept(true);
+        void removeDeletedAlFiles() noexcept(true);
+
+        // number and order independent checksum of all primaryIndex records
+        void getPrimaryIndexChecksum(size_t& recordsNumber, uint64_t& checksum) noexcept(true);
+
+        void copyPrimIndexIntoAl(const std::function<bool(const leveldb::Slice&)>& skipRecord) noexcept(true);
         void flushRamBuffer() noexcept(true);
         std::vector<std::reference_wrapper<DBAdaptiveMergingIndex::DBAdaptiveLog::DBAdaptiveLogEntry>> getALLogEntriesForRange(const std::string& minKey, const std::string& maxKey) noexcept(true);
 
     public:
+        // Manifest (MANIFEST file in AL folder), all integers are fixed size little endian (see DBCoding):
+        // magic32 | version32 | sequence64 | newFileId64 | secIndexRecordsNumber64 | primaryRecordsNumber64 | primaryChecksum64 | flags8 | numEntries32 |
+        // numEntries * (fileId64 | fileName (size32 | name) | minKey (size32 | key) | maxKey (size32 | key) | numRecords64 | numTouched64 | shouldBeDeleted8 | touchedBitmap (size32 | bits)) |
+        // crc32c32 of all previous bytes
+        static constexpr uint32_t manifestMagic = 0x414C4D31; // "ALM1"
+        static constexpr uint32_t manifestVersion = 3;
+        static constexpr const char* manifestFileName = "MANIFEST";
+        static constexpr uint8_t manifestFlagClosed = 1; // written on close, secIndexRecordsNumber is valid
+        static constexpr uint8_t manifestFlagOwnRecords = 2;
+
         void insertRecord(const DBRecord& r) noexcept(true) override;
         void deleteRecord(const std::string& key) noexcept(true) override;
         std::vector<DBRecord> psearch(const std::string& key) noexcept(true) override;
         std::vector<DBRecord> rsearch(const std::string& minKey, const std::string& maxKey) noexcept(true) override;
         std::vector<DBRecord> getAllRecords() noexcept(true) override;
+        void rsearchInto(const std::string& minKey, const std::string& maxKey, DBRecordSet& out) noexcept(true) override;
+        void getAllRecordsInto(DBRecordSet& out) noexcept(true) override;
+
+        // merges ramBuffer, mergeBuffer and all AL files, records are only read (not moved into mergeBuffer)
+        std::unique_ptr<DBIndexCursor> newCursor() noexcept(true) override;
 
         size_t getRecordsNumber() noexcept(true) override
         {
-            return alRecordsNumber + ramBuffer->getRecordsNumber();
+            std::shared_lock<std::shared_mutex> lock(alMutex);
+            return alRecordsNumber + ramBuffer->getRecordsNumber() + mergeBuffer->getRecordsNumber();
         }
 
         std::string getIndexFolder() noexcept(true) override
@@ -79,20 +162,86 @@ private:
             return alFolderPath;
         }
 
-        DBAdaptiveLog(const std::shared_ptr<DBLevelDbIndex>& primaryIndex, const std::string& alFolderPath, size_t ramBufferCapacity)
+        bool isRestoredFromManifest() const noexcept(true)
+        {
+            return restoredFromManifest;
+        }
+
+        bool isRestoredAfterCrash() const noexcept(true)
+        {
+            return restoredAfterCrash;
+        }
+
+        bool hasOwnRecords() const noexcept(true)
+        {
+            return ownRecords;
+        }
+
+        bool isCheckpointNeeded() const noexcept(true)
+        {
+            return checkpointNeeded;
+        }
+
+        size_t getRestoredSecIndexRecordsNumber() const noexcept(true)
+        {
+            return secIndexRecordsNumber;
+        }
+
+        // restored AL is a copy of the current primaryIndex content (one parallel scan of primaryIndex)
+        bool matchesPrimaryIndex() noexcept(true);
+
+        // drop all AL files and copy primaryIndex into AL again, records for which skipRecord(secKey) is true are not copied
+        void rebuild(const std::function<bool(const leveldb::Slice&)>& skipRecord) noexcept(true);
+
+        // records merged after the last manifest are still untouched in AL, drop those found in secIndex
+        void removeRecordsFoundIn(DBIndex& secIndex) noexcept(true);
+
+        // flush ramBuffer and write the manifest, secIndexRecordsNumber is stored to restore secondary index state on the next open
+        // closed = false only marks AL as being in use, so the next open knows that it has to recover
+        // touched records are dropped by the manifest, so mergeBuffer has to be merged and secondaryIndex flushed before
+        void persist(size_t secIndexRecordsNumber, bool closed = true) noexcept(true);
+
+        // get records waiting for the merge and clear mergeBuffer
+        std::vector<DBRecord> takeMergeBuffer() noexcept(true);
+
+        size_t getMergeBufferRecordsNumber() noexcept(true)
+        {
+            std::shared_lock<std::shared_mutex> lock(alMutex);
+            return mergeBuffer->getRecordsNumber();
+        }
+
+        // task never splits SSTable into runs smaller than this, even if budget per thread is smaller
+        static constexpr size_t minAlBuildRunSize = 1024 * 1024;
+
+        DBAdaptiveLog(const std::shared_ptr<DBLevelDbIndex>& primaryIndex, const std::string& alFolderPath, size_t ramBufferCapacity, double alRewriteThreshold, size_t alBuildMemoryBudget)
         : primaryIndex{primaryIndex},
           ramBuffer{std::make_unique<DBInMemoryIndex>()},
           ramBufferCapacity{ramBufferCapacity},
+          mergeBuffer{std::make_unique<DBInMemoryIndex>()},
+          alRewriteThreshold{alRewriteThreshold},
           alFolderPath{alFolderPath},
-          newFileId{0}
+          alBuildMemoryBudget{alBuildMemoryBudget},
+          alRecordsNumber{0},
+          newFileId{0},
+          manifestSequence{0},
+          restoredFromManifest{false},
+          restoredAfterCrash{false},
+          secIndexRecordsNumber{0},
+          primaryRecordsNumber{0},
+          primaryChecksum{0},
+          ownRecords{false},
+          checkpointNeeded{false}
         {
             std::filesystem::create_directories(alFolderPath);
 
-            LOGGER_LOG_DEBUG("DBAdaptiveMergingIndex::DBAdaptiveLog created path: {}, bufferCapacity: {}", alFolderPath, ramBufferCapacity);
+            LOGGER_LOG_DEBUG("DBAdaptiveMergingIndex::DBAdaptiveLog created path: {}, bufferCapacity: {}, rewriteThreshold: {}", alFolderPath, ramBufferCapacity, alRewriteThreshold);
 
-            copyPrimIndexIntoAl();
-
-            LOGGER_LOG_DEBUG("PrimaryIndex copied to DBAdaptiveMergingIndex::DBAdaptiveLog, ready to use");
+            // without the manifest AL is empty, owner decides how to rebuild it (AL files are left as they are)
+            if (loadManifest())
+            {
+                restoredFromManifest = true;
+                LOGGER_LOG_DEBUG("DBAdaptiveMergingIndex::DBAdaptiveLog restored from manifest, files: {}, records: {}, after crash: {}", alFiles.size(), alRecordsNumber.load(), restoredAfterCrash);
+            }
         }
 
         virtual ~DBAdaptiveLog() noexcept(true)
@@ -109,16 +258,44 @@ private:
     };
 
 
-    std::mutex dbMutex;
+    // searches and inserts run in parallel with shared lock, deletes and merge of the AL mergeBuffer into secondaryIndex are exclusive
+    std::shared_mutex mergeMutex;
     std::shared_ptr<DBLevelDbIndex> primaryIndex;
     std::unique_ptr<DBLevelDbIndex> secondaryIndex;
     std::unique_ptr<DBAdaptiveLog> adaptiveLog;
 
+    // with asyncMerge searches return before merge, records wait in the AL mergeBuffer (searches read it as well)
+    bool asyncMerge;
+    std::atomic<bool> mergeScheduled;
+    std::mutex mergeTasksMutex;
+    std::vector<std::future<bool>> mergeTasks;
+
+    // above this limit search thread merges inline instead of waiting for the background merge
+    size_t maxPendingMergeRecords;
+
+    // background merge tries the lock with growing pauses, then waits for it
+    static constexpr size_t mergeLockRetries = 8;
+    static constexpr std::chrono::microseconds mergeLockFirstBackoff{100};
+
     void do_insertRecord(const DBRecord& r) noexcept(true);
     void do_deleteRecord(const std::string& key) noexcept(true);
     std::vector<DBRecord> do_psearch(const std::string& key) noexcept(true);
-    std::vector<DBRecord> do_rsearch(const std::string& minKey, const std::string& maxKey) noexcept(true);
-    std::vector<DBRecord> do_getAllRecords() noexcept(true);
+    void do_rsearchInto(const std::string& minKey, const std::string& maxKey, DBRecordSet& out) noexcept(true);
+    void do_getAllRecordsInto(DBRecordSet& out) noexcept(true);
+    std::unique_ptr<DBIndexCursor> do_newCursor() noexcept(true);
+    void do_mergeAdaptiveLog() noexcept(true);
+
+    // move records touched by searches from AL into secondaryIndex
+    void mergeAdaptiveLog() noexcept(true);
+
+    // merge inline or in background depending on asyncMerge
+    void scheduleMergeAdaptiveLog() noexcept(true);
+
+    // restore AL and secondaryIndex state, secondaryIndex is wiped only when it can be rebuilt from primaryIndex
+    void openAdaptiveLog(size_t secIndexBufferCapacity, const DBLevelDbOptions& secIndexOptions) noexcept(true);
+
+    // merge AL, make secondaryIndex durable and write the AL manifest, closed = false while the index is in use
+    void do_persist(bool closed) noexcept(true);
 
 public:
     void insertRecord(const DBRecord& r) noexcept(true) override;
@@ -126,32 +303,61 @@ public:
     std::vector<DBRecord> psearch(const std::string& key) noexcept(true) override;
     std::vector<DBRecord> rsearch(const std::string& minKey, const std::string& maxKey) noexcept(true) override;
     std::vector<DBRecord> getAllRecords() noexcept(true) override;
+    void rsearchInto(const std::string& minKey, const std::string& maxKey, DBRecordSet& out) noexcept(true) override;
+    void getAllRecordsInto(DBRecordSet& out) noexcept(true) override;
+
+    // merging cursor over AL and secondaryIndex, it does not trigger adaptive merging
+    std::unique_ptr<DBIndexCursor> newCursor() noexcept(true) override;
 
     size_t getRecordsNumber() noexcept(true) override
     {
-        std::lock_guard<std::mutex> lock(dbMutex);
+        std::shared_lock<std::shared_mutex> lock(mergeMutex);
         return secondaryIndex->getRecordsNumber() + adaptiveLog->getRecordsNumber();
     }
 
     std::string getIndexFolder() noexcept(true) override
     {
-        std::lock_guard<std::mutex> lock(dbMutex);
+        std::shared_lock<std::shared_mutex> lock(mergeMutex);
         return primaryIndex->getIndexFolder();
     }
 
-    DBAdaptiveMergingIndex(const std::shared_ptr<DBLevelDbIndex>& primaryIndex, size_t secIndexBufferCapacity = 100 * 1000, size_t amBufferCapacity = 1000)
+    // primaryIndex is opened by the caller with its own options, secIndexOptions tune the secondary index
+    // (secondary index is read by point lookups, so Bloom filter and block cache are worth it there)
+    // alBuildMemoryBudget bounds bytes of records in memory while AL is built from primaryIndex, AL can be larger than RAM
+    // with asyncMerge search merges inline when maxPendingMergeRecords records wait for the merge
+    DBAdaptiveMergingIndex(const std::shared_ptr<DBLevelDbIndex>& primaryIndex, size_t secIndexBufferCapacity = 100 * 1000, size_t amBufferCapacity = 1000, double alRewriteThreshold = 0.5, bool asyncMerge = false, const DBLevelDbOptions& secIndexOptions = DBLevelDbOptions(), size_t alBuildMemoryBudget = 256 * 1024 * 1024, size_t maxPendingMergeRecords = 100 * 1000)
     : primaryIndex{primaryIndex},
-      secondaryIndex{std::make_unique<DBLevelDbIndex>(primaryIndex->getIndexFolder() + std::string("_secIndex"), secIndexBufferCapacity)},
-      adaptiveLog{std::make_unique<DBAdaptiveMergingIndex::DBAdaptiveLog>(primaryIndex, primaryIndex->getIndexFolder() + std::string("_al"), amBufferCapacity)}
+      secondaryIndex{std::make_unique<DBLevelDbIndex>(primaryIndex->getIndexFolder() + std::string("_secIndex"), secIndexBufferCapacity, secIndexOptions)},
+      adaptiveLog{std::make_unique<DBAdaptiveMergingIndex::DBAdaptiveLog>(primaryIndex, primaryIndex->getIndexFolder() + std::string("_al"), amBufferCapacity, alRewriteThreshold, alBuildMemoryBudget)},
+      asyncMerge{asyncMerge},
+      mergeScheduled{false},
+      maxPendingMergeRecords{maxPendingMergeRecords}
     {
-        LOGGER_LOG_DEBUG("DBAdaptiveMergingIndex created with Index: (path: {}, entries: {}), secIndexBufferCapacity: {} amBufferCapacity: {}",
+        LOGGER_LOG_DEBUG("DBAdaptiveMergingIndex created with Index: (path: {}, entries: {}), secIndexBufferCapacity: {} amBufferCapacity: {} alRewriteThreshold: {} asyncMerge: {} alBuildMemoryBudget: {} maxPendingMergeRecords: {}",
                          primaryIndex->getIndexFolder(),
                          primaryIndex->getRecordsNumber(),
                          secIndexBufferCapacity,
-                         amBufferCapacity);
+                         amBufferCapacity,
+                         alRewriteThreshold,
+                         asyncMerge,
+                         alBuildMemoryBudget,
+                         maxPendingMergeRecords);
+
+        openAdaptiveLog(secIndexBufferCapacity, secIndexOptions);
     }
 
-    virtual ~DBAdaptiveMergingIndex() noexcept(true) = default;
+    virtual ~DBAdaptiveMergingIndex() noexcept(true)
+    {
+        // background merges use this object, wait for them
+        {
+            std::lock_guard<std::mutex> tasksLock(mergeTasksMutex);
+            for (auto& t : mergeTasks)
+                t.wait();
+        }
+
+        std::lock_guard<std::shared_mutex> lock(mergeMutex);
+        do_persist(true);
+    }
 
     DBAdaptiveMergingIndex() = delete;
     DBAdaptiveMergingIndex(const DBAdaptiveMergingIndex&) = delete;
@@ -3,21 +3,30 @@
 
 #include <dbRecord.hpp>
 #include <dbWriteBuffer.hpp>
+#include <dbLevelDbOptions.hpp>
 
 #include <vector>
+#include <string>
 
 class DBBenchmark
 {
 private:
     static std::vector<size_t> generateAMQueries(size_t databaseEntries, double sel) noexcept(true);
 
+    // records are compared by key and val, order of found records does not matter
+    static bool sameRecords(const std::string& indexName, const std::string& query, std::vector<DBRecord> expected, std::vector<DBRecord> found) noexcept(true);
+
 public:
-    static void leveldbBenchmarkPut(const std::vector<DBRecord>& entries, size_t millisecondsSleep, bool flushFileSystemBuffer = true) noexcept(true);
-    static void leveldbBenchmarkWritebatch(const std::vector<DBRecord>& entries, size_t batchSize, size_t millisecondsSleep, bool flushFileSystemBuffer = true) noexcept(true);
-    static void leveldbBenchmarkAMSimulation(const std::vector<DBRecord>& entries, double sel, size_t millisecondsSleep, bool flushFileSystemBuffer = true) noexcept(true);
-    static void leveldbBenchmarkAMSimulationWithWriteBuffer(const std::vector<DBRecord>& entries, size_t bufferSize, double sel, size_t millisecondsSleep, bool flushFileSystemBuffer = true) noexcept(true);
+    static void leveldbBenchmarkPut(const std::vector<DBRecord>& entries, size_t millisecondsSleep, bool flushFileSystemBuffer = true, const DBLevelDbOptions& dbOptions = DBLevelDbOptions()) noexcept(true);
+    static void leveldbBenchmarkWritebatch(const std::vector<DBRecord>& entries, size_t batchSize, size_t millisecondsSleep, bool flushFileSystemBuffer = true, const DBLevelDbOptions& dbOptions = DBLevelDbOptions()) noexcept(true);
+    static void leveldbBenchmarkAMSimulation(const std::vector<DBRecord>& entries, double sel, size_t millisecondsSleep, bool flushFileSystemBuffer = true, const DBLevelDbOptions& dbOptions = DBLevelDbOptions()) noexcept(true);
+    static void leveldbBenchmarkAMSimulationWithWriteBuffer(const std::vector<DBRecord>& entries, size_t bufferSize, double sel, size_t millisecondsSleep, bool flushFileSystemBuffer = true, const DBLevelDbOptions& dbOptions = DBLevelDbOptions()) noexcept(true);
 
     static void leveldbBenchmark() noexcept(true);
+
+    // runs the same workload (searches, inserts, deletes) on AM and full scan and compares results with DBInMemoryIndex
+    // returns false when any result differs, differences are logged
+    static bool indexesResultsCheck(size_t numEntries, size_t valSize, size_t numQueries, bool asyncMerge = false) noexcept(true);
 };
 
 #endif
\ No newline at end of file
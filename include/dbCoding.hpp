@@ -0,0 +1,31 @@
+#ifndef DB_CODING_HPP
+#define DB_CODING_HPP
+
+#include <leveldb/slice.h>
+
+#include <string>
+#include <cstdint>
+
+// Helpers to build and parse our binary files. All integers are stored as fixed size little endian
+class DBCoding
+{
+public:
+    static void encodeFixed32(char* dst, uint32_t val) noexcept(true);
+    static void encodeFixed64(char* dst, uint64_t val) noexcept(true);
+    static uint32_t decodeFixed32(const char* src) noexcept(true);
+    static uint64_t decodeFixed64(const char* src) noexcept(true);
+
+    static void putFixed32(std::string& dst, uint32_t val) noexcept(true);
+    static void putFixed64(std::string& dst, uint64_t val) noexcept(true);
+    static void putLengthPrefixedSlice(std::string& dst, const leveldb::Slice& val) noexcept(true);
+
+    // get functions consume data from input, return false when input is too short
+    static bool getFixed32(leveldb::Slice& input, uint32_t& val) noexcept(true);
+    static bool getFixed64(leveldb::Slice& input, uint64_t& val) noexcept(true);
+    static bool getLengthPrefixedSlice(leveldb::Slice& input, leveldb::Slice& val) noexcept(true);
+
+    // CRC32C (Castagnoli)
+    static uint32_t crc32c(const char* data, size_t length) noexcept(true);
+};
+
+#endif
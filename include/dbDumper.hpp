@@ -3,40 +3,55 @@
 
 #include <vector>
 #include <string>
+#include <functional>
+#include <cstdint>
 
 #include <dbRecord.hpp>
 
 #include <leveldb/db.h>
-#include <leveldb/dumpfile.h>
 #include <leveldb/status.h>
 
+// live SSTable of the levelDB, as levelDB reports it in "leveldb.sstables" property
+struct DBSSTableInfo
+{
+    int level = 0;
+    uint64_t fileNumber = 0;
+    uint64_t fileSize = 0; // bytes on disk
+    std::string filePath;
+
+    // user keys, levelDB prints non printable bytes as \xNN and they are unescaped here
+    // key with literal "\xNN" text cannot be told apart from escaped byte, so treat them as hints for pruning and splitting
+    std::string smallestKey;
+    std::string largestKey;
+};
+
 class DBDumper
 {
 private:
-    class DBDumpFileBuffer : public leveldb::WritableFile
-    {
-    private:
-        std::vector<DBRecord> fileRecords;
-    public:
-        leveldb::Status Append(const leveldb::Slice& data) override;
-        leveldb::Status Close() override;
-        leveldb::Status Flush() override;
-        leveldb::Status Sync() override;
-
-        std::vector<DBRecord> getRecords() const noexcept(true)
-        {
-            return fileRecords;
-        }
-    };
-
     static const std::string fileFormatStr;
 
+    // levelDB internal key ends with fixed64 tag, type is its lowest byte
+    static constexpr size_t internalKeyTagSize = 8;
+    static constexpr uint64_t internalKeyTypeValue = 1;
+
     static std::vector<std::string> stringTokenize(const std::string& str, const std::string& delimiter) noexcept(true);
-    static std::string getFileName(const std::string& baseFileName, const std::string& directoryPath) noexcept(true);
+    static std::string getFileName(uint64_t fileNumber, const std::string& directoryPath) noexcept(true);
+    static std::string unescapeKey(const std::string& escapedKey) noexcept(true);
 
 public:
-    // [1][2] -> 3rd file in 2nd level (level and files counted from 0)
+    // all live SSTables ordered by level, files of the same level in levelDB order
+    static std::vector<DBSSTableInfo> getSSTablesInfo(leveldb::DB* db, const std::string& directoryPath) noexcept(true);
+
+    // [1][2] -> 3rd file in 2nd level (level and files counted from 0), empty levels below the last used one are empty vectors
     static std::vector<std::vector<std::string>> getSSTableFiles(leveldb::DB* db, const std::string& directoryPath) noexcept(true);
+
+    // smallest keys of all SSTables (all levels), sorted and unique, good split points for partitioned scans
+    static std::vector<std::string> getSSTableBoundaryKeys(leveldb::DB* db) noexcept(true);
+
+    // f(key, val) for every record of the SSTable in key order, deleted entries are skipped
+    // file is read by levelDB table iterator, slices are valid only inside f
+    static bool forEachSSTableRecord(const std::string& ssTablePath, const std::function<void(const leveldb::Slice&, const leveldb::Slice&)>& f) noexcept(true);
+
     static std::vector<DBRecord> dumpSSTable(const std::string& ssTablePath) noexcept(true);
 };
 
@@ -0,0 +1,176 @@
+#ifndef DB_FLUSH_POLICY_HPP
+#define DB_FLUSH_POLICY_HPP
+
+#include <leveldb/db.h>
+
+#include <string>
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+
+struct DBFlushPolicyStats
+{
+    size_t flushesNumber;
+    size_t compactionsNumber;
+    uint64_t bytesRewritten; // estimated by levelDB approximate size of compacted ranges
+    uint64_t compactionMicroseconds;
+};
+
+// Decides what happens with the levelDB after write buffer flush.
+// Compaction of the flushed range makes reads faster, but on random keys the range is the whole keyspace,
+// so every flush rewrites the whole db. Policies trade write amplification against read performance.
+// Thread safe, one policy can be shared by many buffers: policy state is changed under the lock,
+// but compaction itself runs without it, so long compaction of one db does not block the others.
+class DBFlushPolicy
+{
+protected:
+    struct DBCompactionRange
+    {
+        std::string minKey;
+        std::string maxKey;
+    };
+
+    // estimated bytes which compaction of <minKey, maxKey> rewrites
+    static uint64_t getRangeSize(leveldb::DB* db, const leveldb::Slice& minKey, const leveldb::Slice& maxKey) noexcept(true);
+
+private:
+    std::mutex policyMutex;
+    DBFlushPolicyStats stats;
+
+    // called with policyMutex locked, return true and set range when range has to be compacted now
+    virtual bool do_afterFlush(leveldb::DB* db, const leveldb::Slice& minKey, const leveldb::Slice& maxKey, DBCompactionRange& range) noexcept(true) = 0;
+
+    virtual bool do_runDeferredCompaction(leveldb::DB* db, DBCompactionRange& range) noexcept(true)
+    {
+        (void)db;
+        (void)range;
+        return false;
+    }
+
+    virtual bool do_beforeClose(leveldb::DB* db, DBCompactionRange& range) noexcept(true)
+    {
+        (void)db;
+        (void)range;
+        return false;
+    }
+
+    // compacts range without policyMutex and then updates stats under it
+    void compactRange(leveldb::DB* db, const DBCompactionRange& range) noexcept(true);
+
+public:
+    // records <minKey, maxKey> has been written to db
+    void afterFlush(leveldb::DB* db, const leveldb::Slice& minKey, const leveldb::Slice& maxKey) noexcept(true);
+
+    // owner is idle, policy can do compaction it has postponed
+    void runDeferredCompaction(leveldb::DB* db) noexcept(true);
+
+    // owner is going to close db (or stop writing to it), all postponed work for db is done and policy forgets db
+    void beforeClose(leveldb::DB* db) noexcept(true);
+
+    DBFlushPolicyStats getStats() noexcept(true);
+
+    virtual const char* getName() const noexcept(true) = 0;
+
+    DBFlushPolicy() noexcept(true)
+    : stats{0, 0, 0, 0}
+    {
+
+    }
+
+    virtual ~DBFlushPolicy() noexcept(true) = default;
+    DBFlushPolicy(const DBFlushPolicy&) = delete;
+    DBFlushPolicy(DBFlushPolicy&&) = delete;
+    DBFlushPolicy& operator=(const DBFlushPolicy&) = delete;
+    DBFlushPolicy& operator=(DBFlushPolicy&&) = delete;
+};
+
+// levelDB compacts itself in background
+class DBNoCompactionFlushPolicy : public DBFlushPolicy
+{
+private:
+    bool do_afterFlush(leveldb::DB* db, const leveldb::Slice& minKey, const leveldb::Slice& maxKey, DBCompactionRange& range) noexcept(true) override;
+
+public:
+    const char* getName() const noexcept(true) override
+    {
+        return "none";
+    }
+};
+
+// compacts flushed range right after the flush (default)
+class DBCompactRangeFlushPolicy : public DBFlushPolicy
+{
+private:
+    bool do_afterFlush(leveldb::DB* db, const leveldb::Slice& minKey, const leveldb::Slice& maxKey, DBCompactionRange& range) noexcept(true) override;
+
+public:
+    const char* getName() const noexcept(true) override
+    {
+        return "compactRange";
+    }
+};
+
+// flushed ranges of every db are merged into one pending range of this db,
+// compacted by runDeferredCompaction (idle time) or beforeClose
+class DBDeferredCompactionFlushPolicy : public DBFlushPolicy
+{
+private:
+    std::map<leveldb::DB*, DBCompactionRange> pendingRanges;
+
+    bool do_afterFlush(leveldb::DB* db, const leveldb::Slice& minKey, const leveldb::Slice& maxKey, DBCompactionRange& range) noexcept(true) override;
+    bool do_runDeferredCompaction(leveldb::DB* db, DBCompactionRange& range) noexcept(true) override;
+    bool do_beforeClose(leveldb::DB* db, DBCompactionRange& range) noexcept(true) override;
+
+protected:
+    void addPendingRange(leveldb::DB* db, const leveldb::Slice& minKey, const leveldb::Slice& maxKey) noexcept(true);
+
+    // moves pending range of db out of the policy, false when db has nothing pending
+    bool takePendingRange(leveldb::DB* db, DBCompactionRange& range) noexcept(true);
+
+    bool hasPendingCompaction(leveldb::DB* db) const noexcept(true)
+    {
+        return pendingRanges.find(db) != std::end(pendingRanges);
+    }
+
+public:
+    const char* getName() const noexcept(true) override
+    {
+        return "deferred";
+    }
+
+    DBDeferredCompactionFlushPolicy() noexcept(true) = default;
+};
+
+// deferred policy which compacts pending range by itself when budget allows
+// budget grows by bytesPerSecond up to one second worth of bytes, compaction bigger than budget can run,
+// but next ones wait until the debt is paid, beforeClose compacts regardless of the budget
+class DBBudgetCompactionFlushPolicy : public DBDeferredCompactionFlushPolicy
+{
+private:
+    uint64_t bytesPerSecond;
+    double budget;
+    std::chrono::steady_clock::time_point lastRefill;
+
+    void refillBudget() noexcept(true);
+
+    // takes pending range when budget allows, budget is charged by estimated size before the compaction runs
+    bool takePendingRangeIfBudget(leveldb::DB* db, DBCompactionRange& range) noexcept(true);
+
+    bool do_afterFlush(leveldb::DB* db, const leveldb::Slice& minKey, const leveldb::Slice& maxKey, DBCompactionRange& range) noexcept(true) override;
+    bool do_runDeferredCompaction(leveldb::DB* db, DBCompactionRange& range) noexcept(true) override;
+
+public:
+    const char* getName() const noexcept(true) override
+    {
+        return "budget";
+    }
+
+    DBBudgetCompactionFlushPolicy(uint64_t bytesPerSecond) noexcept(true)
+    : bytesPerSecond{bytesPerSecond}, budget{static_cast<double>(bytesPerSecond)}, lastRefill{std::chrono::steady_clock::now()}
+    {
+
+    }
+};
+
+#endif
@@ -2,22 +2,27 @@
 #define DB_INMEMORY_INDEX
 
 #include <dbIndex.hpp>
+#include <dbSkipList.hpp>
 
 #include <string>
-#include <map>
+#include <memory>
 #include <mutex>
 
+// Writers are serialized by dbMutex, readers do not lock (see DBSkipList)
 class DBInMemoryIndex : public DBIndex
 {
 private:
     std::mutex dbMutex;
-    std::map<std::string, DBRecord> index;
+    std::shared_ptr<DBSkipList> index;
 
     void do_insertRecord(const DBRecord& r) noexcept(true);
     void do_deleteRecord(const std::string& key) noexcept(true);
     std::vector<DBRecord> do_psearch(const std::string& key) noexcept(true);
     std::vector<DBRecord> do_rsearch(const std::string& minKey, const std::string& maxKey) noexcept(true);
     std::vector<DBRecord> do_getAllRecords() noexcept(true);
+    void do_rsearchInto(const std::string& minKey, const std::string& maxKey, DBRecordSet& out) noexcept(true);
+    void do_getAllRecordsInto(DBRecordSet& out) noexcept(true);
+    std::unique_ptr<DBIndexCursor> do_newCursor() noexcept(true);
 
 public:
     void insertRecord(const DBRecord& r) noexcept(true) override;
@@ -25,11 +30,22 @@ public:
     std::vector<DBRecord> psearch(const std::string& key) noexcept(true) override;
     std::vector<DBRecord> rsearch(const std::string& minKey, const std::string& maxKey) noexcept(true) override;
     std::vector<DBRecord> getAllRecords() noexcept(true) override;
+    void rsearchInto(const std::string& minKey, const std::string& maxKey, DBRecordSet& out) noexcept(true) override;
+    void getAllRecordsInto(DBRecordSet& out) noexcept(true) override;
+
+    // cursor walks the live list (no copy), it sees records inserted after its creation
+    // and stays valid after this index is destroyed
+    std::unique_ptr<DBIndexCursor> newCursor() noexcept(true) override;
 
     size_t getRecordsNumber() noexcept(true) override
     {
-        std::lock_guard<std::mutex> lock(dbMutex);
-        return index.size();
+        return index->getRecordsNumber();
+    }
+
+    // deleted records still use memory, owners flush the buffer when this reaches buffer capacity
+    size_t getNodesNumber() noexcept(true)
+    {
+        return index->getNodesNumber();
     }
 
     std::string getIndexFolder() noexcept(true) override
@@ -38,6 +54,7 @@ public:
     }
 
     DBInMemoryIndex()
+    : index{std::make_shared<DBSkipList>()}
     {
 
     }
@@ -49,4 +66,4 @@ public:
     DBInMemoryIndex& operator=(DBInMemoryIndex&&) = delete;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -2,8 +2,11 @@
 #define DB_INDEX_HPP
 
 #include <dbRecord.hpp>
+#include <dbRecordSet.hpp>
+#include <dbIndexCursor.hpp>
 
 #include <string>
+#include <memory>
 
 class DBIndex
 {
@@ -13,6 +16,24 @@ public:
     virtual std::vector<DBRecord> psearch(const std::string& key) noexcept(true) = 0;
     virtual std::vector<DBRecord> rsearch(const std::string& minKey, const std::string& maxKey) noexcept(true) = 0;
     virtual std::vector<DBRecord> getAllRecords() noexcept(true) = 0;
+
+    // same as rsearch / getAllRecords, but records are appended to the arena backed set
+    // indexes which can produce records directly should override them
+    virtual void rsearchInto(const std::string& minKey, const std::string& maxKey, DBRecordSet& out) noexcept(true)
+    {
+        for (const auto& r : rsearch(minKey, maxKey))
+            out.append(r);
+    }
+
+    virtual void getAllRecordsInto(DBRecordSet& out) noexcept(true)
+    {
+        for (const auto& r : getAllRecords())
+            out.append(r);
+    }
+
+    // stream records in key order without materializing them, memory used by the cursor does not depend on the result size
+    virtual std::unique_ptr<DBIndexCursor> newCursor() noexcept(true) = 0;
+
     virtual size_t getRecordsNumber() noexcept(true) = 0;
     virtual std::string getIndexFolder() noexcept(true) = 0;
 
@@ -0,0 +1,182 @@
+#ifndef DB_INDEX_CURSOR_HPP
+#define DB_INDEX_CURSOR_HPP
+
+#include <dbRecordSet.hpp>
+
+#include <leveldb/slice.h>
+#include <leveldb/iterator.h>
+
+#include <memory>
+#include <vector>
+
+// Streaming access to index records in key order, new cursor points to the first record.
+// Slices returned by getKey and getVal are valid until the next move of the cursor.
+// Cursor must not outlive the index which created it.
+class DBIndexCursor
+{
+public:
+    virtual bool isValid() const noexcept(true) = 0;
+    virtual void seekToFirst() noexcept(true) = 0;
+
+    // move to the first record with key >= key
+    virtual void seek(const leveldb::Slice& key) noexcept(true) = 0;
+    virtual void next() noexcept(true) = 0;
+
+    virtual leveldb::Slice getKey() const noexcept(true) = 0;
+    virtual leveldb::Slice getVal() const noexcept(true) = 0;
+
+    virtual ~DBIndexCursor() noexcept(true)
+    {
+
+    }
+};
+
+// Cursor over own DBRecordSet, records in set have to be sorted by key
+class DBRecordSetCursor : public DBIndexCursor
+{
+private:
+    DBRecordSet records;
+    size_t pos;
+
+public:
+    bool isValid() const noexcept(true) override
+    {
+        return pos < records.size();
+    }
+
+    void seekToFirst() noexcept(true) override
+    {
+        pos = 0;
+    }
+
+    void seek(const leveldb::Slice& key) noexcept(true) override;
+
+    void next() noexcept(true) override
+    {
+        ++pos;
+    }
+
+    leveldb::Slice getKey() const noexcept(true) override
+    {
+        return records.getKey(pos);
+    }
+
+    leveldb::Slice getVal() const noexcept(true) override
+    {
+        return records.getVal(pos);
+    }
+
+    explicit DBRecordSetCursor(DBRecordSet&& records)
+    : records{std::move(records)}, pos{0}
+    {
+
+    }
+
+    virtual ~DBRecordSetCursor() noexcept(true) = default;
+
+    DBRecordSetCursor() = delete;
+    DBRecordSetCursor(const DBRecordSetCursor&) = delete;
+    DBRecordSetCursor(DBRecordSetCursor&&) = delete;
+    DBRecordSetCursor& operator=(const DBRecordSetCursor&) = delete;
+    DBRecordSetCursor& operator=(DBRecordSetCursor&&) = delete;
+};
+
+// Cursor over levelDB iterator, iterator sees implicit snapshot of the db taken on its creation
+class DBLevelDbCursor : public DBIndexCursor
+{
+private:
+    std::unique_ptr<leveldb::Iterator> it;
+
+public:
+    bool isValid() const noexcept(true) override
+    {
+        return it->Valid();
+    }
+
+    void seekToFirst() noexcept(true) override
+    {
+        it->SeekToFirst();
+    }
+
+    void seek(const leveldb::Slice& key) noexcept(true) override
+    {
+        it->Seek(key);
+    }
+
+    void next() noexcept(true) override
+    {
+        it->Next();
+    }
+
+    leveldb::Slice getKey() const noexcept(true) override
+    {
+        return it->key();
+    }
+
+    leveldb::Slice getVal() const noexcept(true) override
+    {
+        return it->value();
+    }
+
+    explicit DBLevelDbCursor(leveldb::Iterator* it)
+    : it{it}
+    {
+        this->it->SeekToFirst();
+    }
+
+    virtual ~DBLevelDbCursor() noexcept(true) = default;
+
+    DBLevelDbCursor() = delete;
+    DBLevelDbCursor(const DBLevelDbCursor&) = delete;
+    DBLevelDbCursor(DBLevelDbCursor&&) = delete;
+    DBLevelDbCursor& operator=(const DBLevelDbCursor&) = delete;
+    DBLevelDbCursor& operator=(DBLevelDbCursor&&) = delete;
+};
+
+// Merges sorted child cursors into one sorted stream.
+// Records with equal keys are returned from every child, in children order.
+class DBMergingCursor : public DBIndexCursor
+{
+private:
+    std::vector<std::unique_ptr<DBIndexCursor>> children;
+    DBIndexCursor* current;
+
+    // few children (buffers, AL files, levelDB), so linear scan is cheaper than a heap
+    void findSmallest() noexcept(true);
+
+public:
+    bool isValid() const noexcept(true) override
+    {
+        return current != nullptr;
+    }
+
+    void seekToFirst() noexcept(true) override;
+    void seek(const leveldb::Slice& key) noexcept(true) override;
+    void next() noexcept(true) override;
+
+    leveldb::Slice getKey() const noexcept(true) override
+    {
+        return current->getKey();
+    }
+
+    leveldb::Slice getVal() const noexcept(true) override
+    {
+        return current->getVal();
+    }
+
+    explicit DBMergingCursor(std::vector<std::unique_ptr<DBIndexCursor>>&& children)
+    : children{std::move(children)}, current{nullptr}
+    {
+        seekToFirst();
+    }
+
+    virtual ~DBMergingCursor() noexcept(true) = default;
+
+    DBMergingCursor() = delete;
+    DBMergingCursor(const DBMergingCursor&) = delete;
+    DBMergingCursor(DBMergingCursor&&) = delete;
+    DBMergingCursor& operator=(const DBMergingCursor&) = delete;
+    DBMergingCursor& operator=(DBMergingCursor&&) = delete;
+};
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef DB_INTERVAL_INDEX_HPP
+#define DB_INTERVAL_INDEX_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <random>
+#include <cstdint>
+
+// Interval tree over key ranges <minKey, maxKey> identified by id.
+// Treap ordered by (minKey, id), each node keeps the biggest maxKey of its subtree,
+// so overlap query skips subtrees which end before the range. Not thread safe, owner has to lock it.
+class DBIntervalIndex
+{
+private:
+    struct DBIntervalIndexNode
+    {
+        std::string minKey;
+        std::string maxKey;
+        std::string subtreeMaxKey;
+        size_t id;
+        uint32_t priority;
+        std::unique_ptr<DBIntervalIndexNode> left;
+        std::unique_ptr<DBIntervalIndexNode> right;
+
+        DBIntervalIndexNode(size_t id, const std::string& minKey, const std::string& maxKey, uint32_t priority)
+        : minKey{minKey}, maxKey{maxKey}, subtreeMaxKey{maxKey}, id{id}, priority{priority}
+        {
+
+        }
+    };
+
+    std::unique_ptr<DBIntervalIndexNode> root;
+    std::unordered_map<size_t, std::string> minKeys; // id -> minKey, needed to find node by id
+    std::mt19937 priorityGenerator;
+
+    static bool isLess(const std::string& minKeyA, size_t idA, const std::string& minKeyB, size_t idB) noexcept(true);
+    static void updateSubtreeMaxKey(DBIntervalIndexNode* node) noexcept(true);
+
+    // split tree into nodes less than (minKey, id) and the rest
+    static void split(std::unique_ptr<DBIntervalIndexNode> node, const std::string& minKey, size_t id, std::unique_ptr<DBIntervalIndexNode>& less, std::unique_ptr<DBIntervalIndexNode>& greaterEqual) noexcept(true);
+    static std::unique_ptr<DBIntervalIndexNode> merge(std::unique_ptr<DBIntervalIndexNode> less, std::unique_ptr<DBIntervalIndexNode> greater) noexcept(true);
+
+    static void insertNode(std::unique_ptr<DBIntervalIndexNode>& node, std::unique_ptr<DBIntervalIndexNode> newNode) noexcept(true);
+    static void eraseNode(std::unique_ptr<DBIntervalIndexNode>& node, const std::string& minKey, size_t id) noexcept(true);
+    static void queryNode(const DBIntervalIndexNode* node, const std::string& minKey, const std::string& maxKey, std::vector<size_t>& ret) noexcept(true);
+
+public:
+    void insert(size_t id, const std::string& minKey, const std::string& maxKey) noexcept(true);
+    void erase(size_t id) noexcept(true);
+
+    // key range of id has changed (or id is new)
+    void update(size_t id, const std::string& minKey, const std::string& maxKey) noexcept(true);
+
+    // ids of all intervals overlapping <minKey, maxKey>, ordered by minKey
+    std::vector<size_t> query(const std::string& minKey, const std::string& maxKey) const noexcept(true);
+
+    void clear() noexcept(true);
+
+    size_t size() const noexcept(true)
+    {
+        return minKeys.size();
+    }
+
+    DBIntervalIndex()
+    : priorityGenerator{0x414C}
+    {
+
+    }
+
+    virtual ~DBIntervalIndex() noexcept(true);
+
+    DBIntervalIndex(const DBIntervalIndex&) = delete;
+    DBIntervalIndex(DBIntervalIndex&&) = delete;
+    DBIntervalIndex& operator=(const DBIntervalIndex&) = delete;
+    DBIntervalIndex& operator=(DBIntervalIndex&&) = delete;
+};
+
+#endif
@@ -3,22 +3,36 @@
 
 #include <dbLevelDbIndex.hpp>
 #include <dbIndex.hpp>
+#include <dbSecondaryKeyFilter.hpp>
 #include <logger.hpp>
 
 #include <memory>
 #include <mutex>
+#include <algorithm>
 
 class DBLevelDbFullScan : public DBIndex
 {
 private:
-    std::unique_ptr<DBIndex> primaryIndex;
+    std::unique_ptr<DBLevelDbIndex> primaryIndex;
     std::mutex dbMutex;
 
+    // secondary key is the 8 bytes prefix of the value, compared in place without a copy
+    static leveldb::Slice getSecondaryKey(const leveldb::Slice& val) noexcept(true)
+    {
+        return leveldb::Slice(val.data(), std::min(val.size(), DBSecondaryKeyFilter::keySize));
+    }
+
+    // more partitions than threads, so a thread with a short key range can take next one
+    static constexpr size_t scanPartitionsPerThread = 4;
+
+    static size_t getScanPartitionsNumber() noexcept(true);
+
     void do_insertRecord(const DBRecord& r) noexcept(true);
     void do_deleteRecord(const std::string& key) noexcept(true);
     std::vector<DBRecord> do_psearch(const std::string& key) noexcept(true);
-    std::vector<DBRecord> do_rsearch(const std::string& minKey, const std::string& maxKey) noexcept(true);
+    void do_rsearchInto(const std::string& minKey, const std::string& maxKey, DBRecordSet& out) noexcept(true);
     std::vector<DBRecord> do_getAllRecords() noexcept(true);
+    std::unique_ptr<DBIndexCursor> do_newCursor() noexcept(true);
 
 public:
     // record is normal: key: primary key, value: secondary value which is secondaryKey|padding
@@ -34,6 +48,12 @@ public:
     std::vector<DBRecord> rsearch(const std::string& minKey, const std::string& maxKey) noexcept(true) override;
     std::vector<DBRecord> getAllRecords() noexcept(true) override;
 
+    // predicate is evaluated in parallel on SSTable key ranges, partition results are spliced in key range order
+    void rsearchInto(const std::string& minKey, const std::string& maxKey, DBRecordSet& out) noexcept(true) override;
+
+    // records in primary key order
+    std::unique_ptr<DBIndexCursor> newCursor() noexcept(true) override;
+
     size_t getRecordsNumber() noexcept(true) override
     {
         std::lock_guard<std::mutex> lock(dbMutex);
@@ -46,8 +66,8 @@ public:
         return primaryIndex->getIndexFolder();
     }
 
-    DBLevelDbFullScan(const std::string& dbFolderPath, size_t bufferCapacity = 100 * 1000)
-    : primaryIndex{std::make_unique<DBLevelDbIndex>(dbFolderPath, bufferCapacity)}
+    DBLevelDbFullScan(const std::string& dbFolderPath, size_t bufferCapacity = 100 * 1000, const DBLevelDbOptions& dbOptions = DBLevelDbOptions())
+    : primaryIndex{std::make_unique<DBLevelDbIndex>(dbFolderPath, bufferCapacity, dbOptions)}
     {
         LOGGER_LOG_DEBUG("DBLevelDbFullScan created path:{}, bufferCapacity: {}", dbFolderPath, bufferCapacity);
     }
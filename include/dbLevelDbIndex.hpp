@@ -4,67 +4,177 @@
 #include <dbIndex.hpp>
 #include <logger.hpp>
 #include <dbInMemoryIndex.hpp>
+#include <dbFlushPolicy.hpp>
+#include <dbLevelDbOptions.hpp>
 
 #include <leveldb/db.h>
 
 #include <string>
 #include <memory>
 #include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <future>
+#include <functional>
 
 class DBLevelDbIndex : public DBIndex
 {
 private:
-    std::unique_ptr<DBIndex> inMemoryIndex;
+    // full inMemoryIndex becomes immutable and is flushed by the pool task, new records go to the fresh inMemoryIndex
+    // searches read both buffers and the levelDB
+    std::shared_ptr<DBInMemoryIndex> inMemoryIndex;
+    std::shared_ptr<DBInMemoryIndex> immutableInMemoryIndex; // nullptr when no flush is pending
     size_t inMemoryIndexCapacity;
-    std::mutex dbMutex;
+    std::shared_mutex dbMutex; // searches take shared lock, levelDB and inMemoryIndex are thread safe for readers
+    std::condition_variable_any flushDone; // notified (with dbMutex) when immutableInMemoryIndex is written to the levelDB and when flush task ends
+    size_t pendingFlushTasks; // flush tasks not finished yet (flush policy included), guarded by dbMutex
+
+    // levelDB state from before the pending flush, readers see records of immutableInMemoryIndex only once (from the buffer)
+    // taken and released with dbMutex locked exclusively together with the swap of buffers, nullptr when no flush is pending
+    const leveldb::Snapshot* flushSnapshot;
+    std::shared_ptr<DBFlushPolicy> flushPolicy;
 
     std::string dbFolderPath;
+    DBLevelDbOptions dbOptions;
+    std::unique_ptr<leveldb::Cache> blockCache; // owned here, levelDB keeps only raw pointers
+    std::unique_ptr<const leveldb::FilterPolicy> filterPolicy;
     leveldb::DB* db;
     size_t entriesInLevelDb;
 
-    void do_insertRecord(const DBRecord& r) noexcept(true);
-    void do_deleteRecord(const std::string& key) noexcept(true);
+    void do_insertRecord(const DBRecord& r, std::unique_lock<std::shared_mutex>& lock) noexcept(true);
+    void do_insertRecords(const std::vector<DBRecord>& records, std::unique_lock<std::shared_mutex>& lock) noexcept(true);
+    void do_deleteRecord(const std::string& key, std::unique_lock<std::shared_mutex>& lock) noexcept(true);
     std::vector<DBRecord> do_psearch(const std::string& key) noexcept(true);
     std::vector<DBRecord> do_rsearch(const std::string& minKey, const std::string& maxKey) noexcept(true);
     std::vector<DBRecord> do_getAllRecords() noexcept(true);
-    void flushInMemoryIndex() noexcept(true);
-    void do_flushInMemoryIndex() noexcept(true);
+    void do_rsearchInto(const std::string& minKey, const std::string& maxKey, DBRecordSet& out) noexcept(true);
+    void do_getAllRecordsInto(DBRecordSet& out) noexcept(true);
+    std::unique_ptr<DBIndexCursor> do_newCursor() noexcept(true);
+    void do_forEachRecord(const std::function<bool(const leveldb::Slice&, const leveldb::Slice&)>& f) noexcept(true);
+    void do_forEachRecordParallel(size_t maxPartitions, const std::function<bool(size_t, const leveldb::Slice&, const leveldb::Slice&)>& f) noexcept(true);
+    void do_flushInMemoryIndex(std::unique_lock<std::shared_mutex>& lock) noexcept(true);
+
+    // swap full inMemoryIndex with the fresh one and flush it in background
+    void do_scheduleFlush(std::unique_lock<std::shared_mutex>& lock) noexcept(true);
+
+    // releases dbMutex until pending flush is done
+    void waitForFlush(std::unique_lock<std::shared_mutex>& lock) noexcept(true);
+
+    leveldb::ReadOptions getReadOptions() const noexcept(true)
+    {
+        leveldb::ReadOptions readOptions;
+        readOptions.snapshot = flushSnapshot;
+
+        return readOptions;
+    }
+
+    void writeRecords(const std::vector<DBRecord>& records) noexcept(true);
+    void afterFlush(const std::vector<DBRecord>& records) noexcept(true);
+
+    // keys of records in order, sorted runs (buffer, AL merge) are not sorted again
+    static std::vector<leveldb::Slice> getSortedKeys(const std::vector<DBRecord>& records) noexcept(true);
+
+    // f(i) for every keys[i] found by the cursor, keys have to be sorted, cursor moves only forward:
+    // short gaps between keys are walked by next, longer ones are skipped by seek
+    static void forEachFoundKey(DBIndexCursor& cursor, const std::vector<leveldb::Slice>& keys, const std::function<void(size_t)>& f) noexcept(true);
+    static constexpr size_t foundKeyMaxSteps = 16;
+
+    // keys not in the levelDB yet, one iterator pass instead of a point read per key
+    size_t countNewKeys(const std::vector<leveldb::Slice>& keys) noexcept(true);
 
 public:
     void insertRecord(const DBRecord& r) noexcept(true) override;
+
+    // bulk ingest, records (preferably a sorted run) go to the levelDB as one WriteBatch, skipping the buffer
+    // keys inside one batch have to be unique, keys already in the levelDB are overwritten and not counted again
+    void insertRecords(const std::vector<DBRecord>& records) noexcept(true);
+
     void deleteRecord(const std::string& key) noexcept(true) override;
     std::vector<DBRecord> psearch(const std::string& key) noexcept(true) override;
     std::vector<DBRecord> rsearch(const std::string& minKey, const std::string& maxKey) noexcept(true) override;
     std::vector<DBRecord> getAllRecords() noexcept(true) override;
+    void rsearchInto(const std::string& minKey, const std::string& maxKey, DBRecordSet& out) noexcept(true) override;
+    void getAllRecordsInto(DBRecordSet& out) noexcept(true) override;
+
+    // merges buffers with levelDB iterator
+    std::unique_ptr<DBIndexCursor> newCursor() noexcept(true) override;
+
+    // f(key, val) for buffer records and then for levelDB records, f returns false to stop the scan
+    // slices are valid only inside f, scan does not fill the block cache
+    void forEachRecord(const std::function<bool(const leveldb::Slice&, const leveldb::Slice&)>& f) noexcept(true);
+
+    // levelDB is split into at most maxPartitions key ranges at SSTable boundaries, each range is scanned by a pool task
+    // f(partition, key, val) is called concurrently for different partitions, records of one partition come from one task
+    // (buffer records go first to partition 0), f returns false to stop the scan of its partition
+    void forEachRecordParallel(size_t maxPartitions, const std::function<bool(size_t, const leveldb::Slice&, const leveldb::Slice&)>& f) noexcept(true);
 
     size_t getRecordsNumber() noexcept(true) override
     {
-        std::lock_guard<std::mutex> lock(dbMutex);
-        return inMemoryIndex->getRecordsNumber() + entriesInLevelDb;
+        std::shared_lock<std::shared_mutex> lock(dbMutex);
+        return inMemoryIndex->getRecordsNumber() + (immutableInMemoryIndex ? immutableInMemoryIndex->getRecordsNumber() : 0) + entriesInLevelDb;
     }
 
     std::string getIndexFolder() noexcept(true) override
     {
-        std::lock_guard<std::mutex> lock(dbMutex);
+        std::shared_lock<std::shared_mutex> lock(dbMutex);
         return dbFolderPath;
     }
 
+    // levelDB cannot count entries, so owner of the index can restore number saved before close
+    void restoreRecordsNumber(size_t recordsNumber) noexcept(true)
+    {
+        std::lock_guard<std::shared_mutex> lock(dbMutex);
+        entriesInLevelDb = recordsNumber;
+    }
+
+    // buffer is written to the levelDB, from now on records survive a crash of the process (levelDB log)
+    void flushInMemoryIndex() noexcept(true);
+
+    // buffer and levelDB memtable are written to SSTables, so readers of SSTable files see every record
+    // levelDB has no public memtable flush, so whole db is compacted (once, when AL is built from the SSTables)
+    void flushToSSTables() noexcept(true);
+
+    // levelDB pointer does not change, so compaction does not take dbMutex and does not block inserts
+    void runDeferredCompaction() noexcept(true)
+    {
+        flushPolicy->runDeferredCompaction(db);
+    }
+
+    DBFlushPolicyStats getFlushPolicyStats() noexcept(true)
+    {
+        return flushPolicy->getStats();
+    }
+
+    const DBLevelDbOptions& getOptions() const noexcept(true)
+    {
+        return dbOptions;
+    }
+
     leveldb::DB* getLevelDbPtr() noexcept(true)
     {
-        std::lock_guard<std::mutex> lock(dbMutex);
+        std::shared_lock<std::shared_mutex> lock(dbMutex);
         return db;
     }
 
-    DBLevelDbIndex(const std::string& dbFolderPath, size_t bufferCapacity = 100 * 1000)
-    : inMemoryIndex{std::make_unique<DBInMemoryIndex>()}, inMemoryIndexCapacity{bufferCapacity}, dbFolderPath{dbFolderPath}
+    DBLevelDbIndex(const std::string& dbFolderPath,
+                   size_t bufferCapacity = 100 * 1000,
+                   const DBLevelDbOptions& dbOptions = DBLevelDbOptions(),
+                   const std::shared_ptr<DBFlushPolicy>& flushPolicy = std::make_shared<DBCompactRangeFlushPolicy>())
+    : inMemoryIndex{std::make_shared<DBInMemoryIndex>()}, immutableInMemoryIndex{nullptr}, inMemoryIndexCapacity{bufferCapacity}, pendingFlushTasks{0}, flushSnapshot{nullptr}, flushPolicy{flushPolicy}, dbFolderPath{dbFolderPath}, dbOptions{dbOptions}, entriesInLevelDb{0}
     {
         //openDB
-        leveldb::Options options;
-        options.create_if_missing = true;
+        const leveldb::Options options = dbOptions.toLevelDbOptions(blockCache, filterPolicy);
 
         const leveldb::Status status = leveldb::DB::Open(options, dbFolderPath, &db);
 
-        LOGGER_LOG_DEBUG("DBLevelDbIndex created path:{}, bufferCapacity: {}", dbFolderPath, bufferCapacity);
+        LOGGER_LOG_DEBUG("DBLevelDbIndex created path:{}, bufferCapacity: {}, blockCache: {}, bloomBitsPerKey: {}, writeBuffer: {}, maxFileSize: {}, flushPolicy: {}",
+                         dbFolderPath,
+                         bufferCapacity,
+                         dbOptions.blockCacheSize,
+                         dbOptions.bloomFilterBitsPerKey,
+                         dbOptions.writeBufferSize,
+                         dbOptions.maxFileSize,
+                         flushPolicy->getName());
     }
 
     virtual ~DBLevelDbIndex() noexcept(true)
@@ -72,6 +182,15 @@ public:
         // flush buffer before db close
         flushInMemoryIndex();
 
+        // background flushes can still compact their ranges
+        {
+            std::unique_lock<std::shared_mutex> lock(dbMutex);
+            flushDone.wait(lock, [this]() { return pendingFlushTasks == 0; });
+        }
+
+        // compaction postponed by the policy has to run while db is open
+        flushPolicy->beforeClose(db);
+
         // close db
         delete db;
     }
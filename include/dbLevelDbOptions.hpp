@@ -0,0 +1,27 @@
+#ifndef DB_LEVELDB_OPTIONS_HPP
+#define DB_LEVELDB_OPTIONS_HPP
+
+#include <leveldb/options.h>
+#include <leveldb/cache.h>
+#include <leveldb/filter_policy.h>
+
+#include <memory>
+#include <cstddef>
+
+// levelDB tuning knobs, 0 means levelDB default
+struct DBLevelDbOptions
+{
+    size_t blockCacheSize = 0; // bytes of LRU cache for uncompressed blocks
+    int bloomFilterBitsPerKey = 0; // 0 disables Bloom filter, 10 gives ~1% false positives
+    size_t writeBufferSize = 0; // bytes of memtable before it is written to the SSTable
+    size_t maxFileSize = 0; // bytes of one SSTable
+    size_t blockSize = 0; // bytes of uncompressed data in one SSTable block
+    int maxOpenFiles = 0;
+    bool compression = true; // snappy
+
+    // leveldb::Options keeps raw pointers, so cache and filter policy are created here and the caller owns them,
+    // they have to live until db is closed
+    leveldb::Options toLevelDbOptions(std::unique_ptr<leveldb::Cache>& blockCache, std::unique_ptr<const leveldb::FilterPolicy>& filterPolicy) const noexcept(true);
+};
+
+#endif
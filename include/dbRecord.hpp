@@ -6,101 +6,93 @@
 #include <leveldb/db.h>
 
 #include <string>
+#include <algorithm>
 
 class DBRecord
 {
 private:
-    std::string keyData;
-    std::string valData;
-    leveldb::Slice key;
-    leveldb::Slice val;
+    // key and value are stored in one buffer: key | val, slices are computed on demand so move is just a buffer move
+    std::string data;
+    size_t keySize;
+
 public:
     DBRecord(const std::string& keyString, const std::string& valString)
-    : keyData{keyString}, valData{valString}, key(keyData), val(valData)
+    : DBRecord(leveldb::Slice(keyString), leveldb::Slice(valString))
     {
 
     }
 
     DBRecord(const leveldb::Slice& key, const leveldb::Slice& val) noexcept(true)
-    : keyData(key.ToString()), valData(val.ToString()), key(keyData), val(valData)
+    : keySize{key.size()}
     {
-
+        data.reserve(key.size() + val.size());
+        data.append(key.data(), key.size());
+        data.append(val.data(), val.size());
     }
 
     leveldb::Slice getKey() const noexcept(true)
     {
-        return key;
+        return leveldb::Slice(data.data(), keySize);
     }
 
     leveldb::Slice getVal() const noexcept(true)
     {
-        return val;
+        return leveldb::Slice(data.data() + keySize, data.size() - keySize);
     }
 
     size_t getKeySize() const noexcept(true)
     {
-        return key.size();
+        return keySize;
     }
 
     size_t getValSize() const noexcept(true)
     {
-        return val.size();
+        return data.size() - keySize;
     }
 
     size_t getRecordSize() const noexcept(true)
     {
-        return getKeySize() + getValSize();
+        return data.size();
     }
 
     void swapPrimaryKeyWithSecondaryKey() noexcept(true)
     {
         // we need to swap 8 first chars from val (secondary key) with key
-        std::string newKey = valData.substr(0, 8);
-        std::string newValue = keyData + valData.substr(8);
+        // key | val[0:8] | val[8:] -> val[0:8] | key | val[8:]
+        const size_t secKeySize = std::min(static_cast<size_t>(8), getValSize());
 
-        LOGGER_LOG_TRACE("Swapped Record ({}, {}) into Record ({}, {})", keyData, valData, newKey, newValue);
-
-        keyData = newKey;
-        valData = newValue;
-        key = leveldb::Slice(keyData);
-        val = leveldb::Slice(valData);
-    }
+        std::string newData;
+        newData.reserve(data.size());
+        newData.append(data, keySize, secKeySize);
+        newData.append(data, 0, keySize);
+        newData.append(data, keySize + secKeySize, std::string::npos);
 
-    DBRecord(const DBRecord& other) noexcept(true)
-    : DBRecord(other.getKey(), other.getVal())
-    {
+        LOGGER_LOG_TRACE("Swapped Record ({}, {}) into Record ({}, {})", getKey().ToString(), getVal().ToString(), newData.substr(0, secKeySize), newData.substr(secKeySize));
 
+        data = std::move(newData);
+        keySize = secKeySize;
     }
 
-    DBRecord& operator=(const DBRecord& other) noexcept(true)
-    {
-        if (this == &other)
-            return *this;
-
-        keyData = other.getKey().ToString();
-        valData = other.getVal().ToString();
-        key = leveldb::Slice(keyData);
-        val = leveldb::Slice(valData);
+    DBRecord(const DBRecord&) = default;
+    DBRecord& operator=(const DBRecord&) = default;
 
-        return *this;
-    }
-
-    // there is no move. MOVE = COPY
-    DBRecord(DBRecord&& other) noexcept(true)
-    : DBRecord(other.getKey(), other.getVal())
+    // moved-from record is an empty record, so its slices stay inside data
+    DBRecord(DBRecord&& r) noexcept(true)
+    : data{std::move(r.data)}, keySize{r.keySize}
     {
-
+        r.data.clear();
+        r.keySize = 0;
     }
 
-    DBRecord& operator=(DBRecord&& other) noexcept(true)
+    DBRecord& operator=(DBRecord&& r) noexcept(true)
     {
-        if (this == &other)
+        if (this == &r)
             return *this;
 
-        keyData = other.getKey().ToString();
-        valData = other.getVal().ToString();
-        key = leveldb::Slice(keyData);
-        val = leveldb::Slice(valData);
+        data = std::move(r.data);
+        keySize = r.keySize;
+        r.data.clear();
+        r.keySize = 0;
 
         return *this;
     }
@@ -113,29 +105,35 @@ public:
 
     virtual ~DBRecord() noexcept(true) = default;
 
-    bool operator <(const DBRecord& r)
+    // records are ordered by key only
+    bool operator <(const DBRecord& r) const noexcept(true)
+    {
+        return getKey().compare(r.getKey()) < 0;
+    }
+
+    bool operator <=(const DBRecord& r) const noexcept(true)
     {
-        return keyData < r.getKey().ToString();
+        return getKey().compare(r.getKey()) <= 0;
     }
 
-    bool operator <=(const DBRecord& r)
+    bool operator >(const DBRecord& r) const noexcept(true)
     {
-        return keyData <= r.getKey().ToString();
+        return getKey().compare(r.getKey()) > 0;
     }
 
-    bool operator >(const DBRecord& r)
+    bool operator >=(const DBRecord& r) const noexcept(true)
     {
-        return keyData > r.getKey().ToString();
+        return getKey().compare(r.getKey()) >= 0;
     }
 
-    bool operator >=(const DBRecord& r)
+    bool operator ==(const DBRecord& r) const noexcept(true)
     {
-        return keyData < r.getKey().ToString();
+        return getKey() == r.getKey();
     }
 
-    bool operator ==(const DBRecord& r)
+    bool operator !=(const DBRecord& r) const noexcept(true)
     {
-        return keyData < r.getKey().ToString();
+        return getKey() != r.getKey();
     }
 };
 
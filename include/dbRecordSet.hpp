@@ -0,0 +1,101 @@
+#ifndef DB_RECORD_SET_HPP
+#define DB_RECORD_SET_HPP
+
+#include <dbRecord.hpp>
+
+#include <leveldb/slice.h>
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <cstdint>
+
+// Query result container. Keys and values are copied into a few big arena chunks and records are slices into them,
+// so filling the set costs one allocation per chunk instead of one per record.
+// Sets built by different threads can be spliced together without copying any record.
+class DBRecordSet
+{
+private:
+    struct DBRecordSetChunk
+    {
+        std::unique_ptr<char[]> data;
+        size_t capacity;
+        size_t used;
+    };
+
+    struct DBRecordSetEntry
+    {
+        const char* data; // key | val
+        uint32_t keySize;
+        uint32_t valSize;
+    };
+
+    size_t chunkSize;
+    std::vector<DBRecordSetChunk> chunks;
+    std::vector<DBRecordSetEntry> entries;
+
+    char* allocate(size_t size) noexcept(true);
+
+public:
+    static constexpr size_t defaultChunkSize = 64 * 1024;
+
+    void append(const leveldb::Slice& key, const leveldb::Slice& val) noexcept(true);
+
+    void append(const DBRecord& r) noexcept(true)
+    {
+        append(r.getKey(), r.getVal());
+    }
+
+    // move all records from other to the end of this set, chunks are moved so no record is copied
+    void splice(DBRecordSet&& other) noexcept(true);
+
+    void clear() noexcept(true);
+
+    // f(key, val)
+    void forEachRecord(const std::function<void(const leveldb::Slice&, const leveldb::Slice&)>& f) const noexcept(true);
+
+    std::vector<DBRecord> toVector() const noexcept(true);
+
+    leveldb::Slice getKey(size_t i) const noexcept(true)
+    {
+        return leveldb::Slice(entries[i].data, entries[i].keySize);
+    }
+
+    leveldb::Slice getVal(size_t i) const noexcept(true)
+    {
+        return leveldb::Slice(entries[i].data + entries[i].keySize, entries[i].valSize);
+    }
+
+    DBRecord getRecord(size_t i) const noexcept(true)
+    {
+        return DBRecord(getKey(i), getVal(i));
+    }
+
+    size_t size() const noexcept(true)
+    {
+        return entries.size();
+    }
+
+    bool empty() const noexcept(true)
+    {
+        return entries.empty();
+    }
+
+    explicit DBRecordSet(size_t chunkSize = defaultChunkSize)
+    : chunkSize{chunkSize}
+    {
+
+    }
+
+    virtual ~DBRecordSet() noexcept(true) = default;
+
+    // slices point into chunks on the heap, so move keeps them valid
+    DBRecordSet(DBRecordSet&&) noexcept(true) = default;
+    DBRecordSet& operator=(DBRecordSet&&) noexcept(true) = default;
+
+    DBRecordSet(const DBRecordSet&) = delete;
+    DBRecordSet& operator=(const DBRecordSet&) = delete;
+};
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef DB_SECONDARY_KEY_FILTER_HPP
+#define DB_SECONDARY_KEY_FILTER_HPP
+
+#include <leveldb/slice.h>
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// Range predicate minKey <= key <= maxKey for 8 bytes secondary keys.
+// Key is loaded as big endian integer, so integer order is the same as bytes order and one key is compared by 2 integer compares.
+// Batch of keys stored contiguously (key column) is filtered by SIMD kernel (AVX2, SSE4.2 or scalar, selected at runtime).
+class DBSecondaryKeyFilter
+{
+private:
+    std::string minKey;
+    std::string maxKey;
+
+    // bounds for 8 bytes keys, <minKeyValue, maxKeyValue> is the same set of keys as <minKey, maxKey>
+    uint64_t minKeyValue;
+    uint64_t maxKeyValue;
+    bool emptyRange;
+
+public:
+    static constexpr size_t keySize = 8;
+
+    static uint64_t decodeKey(const char* key) noexcept(true)
+    {
+        const unsigned char* const bytes = reinterpret_cast<const unsigned char*>(key);
+
+        return (static_cast<uint64_t>(bytes[0]) << 56) | (static_cast<uint64_t>(bytes[1]) << 48) |
+               (static_cast<uint64_t>(bytes[2]) << 40) | (static_cast<uint64_t>(bytes[3]) << 32) |
+               (static_cast<uint64_t>(bytes[4]) << 24) | (static_cast<uint64_t>(bytes[5]) << 16) |
+               (static_cast<uint64_t>(bytes[6]) << 8) | static_cast<uint64_t>(bytes[7]);
+    }
+
+    // exact for keys of any size, 8 bytes keys take the integer path
+    bool matches(const leveldb::Slice& key) const noexcept(true)
+    {
+        if (key.size() == keySize)
+        {
+            const uint64_t keyValue = decodeKey(key.data());
+            return !emptyRange && keyValue >= minKeyValue && keyValue <= maxKeyValue;
+        }
+
+        return key.compare(leveldb::Slice(minKey)) >= 0 && key.compare(leveldb::Slice(maxKey)) <= 0;
+    }
+
+    // keys: numKeys * 8 bytes, bit i of selection (selection[i / 64] >> (i % 64)) is set when key i matches
+    // selection has to have (numKeys + 63) / 64 words
+    void filter(const char* keys, size_t numKeys, uint64_t* selection) const noexcept(true);
+
+    // name of kernel selected for this CPU
+    static const char* getKernelName() noexcept(true);
+
+    // compares every SIMD kernel supported by this CPU and filter() with the scalar kernel and matches() on random keys and ranges
+    // returns false when any selection differs, differences are logged
+    static bool checkKernels(size_t rounds = 1000) noexcept(true);
+
+    DBSecondaryKeyFilter(const leveldb::Slice& minKey, const leveldb::Slice& maxKey) noexcept(true);
+
+    virtual ~DBSecondaryKeyFilter() noexcept(true) = default;
+
+    DBSecondaryKeyFilter() = delete;
+    DBSecondaryKeyFilter(const DBSecondaryKeyFilter&) = default;
+    DBSecondaryKeyFilter(DBSecondaryKeyFilter&&) = default;
+    DBSecondaryKeyFilter& operator=(const DBSecondaryKeyFilter&) = default;
+    DBSecondaryKeyFilter& operator=(DBSecondaryKeyFilter&&) = default;
+};
+
+#endif
@@ -0,0 +1,187 @@
+#ifndef DB_SKIP_LIST_HPP
+#define DB_SKIP_LIST_HPP
+
+#include <dbIndexCursor.hpp>
+
+#include <leveldb/slice.h>
+
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <cstdint>
+
+// Ordered key -> value map for write buffers, skip list like the levelDB memtable.
+// Nodes, keys and values are allocated in arena chunks and freed only with the whole list.
+// Writers have to be serialized by the owner, readers do not need any lock:
+// node is fully built before it is published by release store, readers follow links by acquire loads.
+// Delete only clears the node value (nullptr), so readers never see freed memory.
+class DBSkipList
+{
+private:
+    static constexpr int maxHeight = 12;
+    static constexpr uint32_t branching = 4;
+    static constexpr size_t arenaChunkSize = 64 * 1024;
+
+    struct DBSkipListNode
+    {
+        const char* key;
+        uint32_t keySize;
+        std::atomic<const char*> value; // valSize32 | val, nullptr when record is deleted
+        std::atomic<DBSkipListNode*> next[1]; // height links, node is allocated with space for all of them
+
+        leveldb::Slice getKey() const noexcept(true)
+        {
+            return leveldb::Slice(key, keySize);
+        }
+    };
+
+    std::vector<std::unique_ptr<char[]>> arenaChunks;
+    char* arenaPtr;
+    size_t arenaRemaining;
+    size_t arenaMemoryUsage;
+
+    DBSkipListNode* head;
+    std::atomic<int> height;
+    uint32_t randomState;
+
+    std::atomic<size_t> recordsNumber;
+    std::atomic<size_t> nodesNumber;
+
+    char* allocate(size_t size) noexcept(true);
+    const char* allocateValue(const leveldb::Slice& val) noexcept(true);
+    DBSkipListNode* newNode(const leveldb::Slice& key, int nodeHeight) noexcept(true);
+    uint32_t nextRandom() noexcept(true);
+    int randomHeight() noexcept(true);
+
+    // first node with key >= key, prev (if not nullptr) gets the last node < key on every level
+    DBSkipListNode* findGreaterOrEqual(const leveldb::Slice& key, DBSkipListNode** prev) const noexcept(true);
+
+public:
+    static leveldb::Slice decodeValue(const char* value) noexcept(true);
+
+    // Iterator skips deleted records, value is read once when iterator stops on a node
+    class Iterator
+    {
+    private:
+        const DBSkipList* list;
+        const DBSkipListNode* node;
+        const char* value;
+
+        void skipDeleted() noexcept(true);
+
+    public:
+        bool isValid() const noexcept(true)
+        {
+            return node != nullptr;
+        }
+
+        leveldb::Slice getKey() const noexcept(true)
+        {
+            return node->getKey();
+        }
+
+        leveldb::Slice getVal() const noexcept(true)
+        {
+            return decodeValue(value);
+        }
+
+        void seekToFirst() noexcept(true);
+        void seek(const leveldb::Slice& key) noexcept(true);
+        void next() noexcept(true);
+
+        explicit Iterator(const DBSkipList* list) noexcept(true)
+        : list{list}, node{nullptr}, value{nullptr}
+        {
+
+        }
+    };
+
+    // writers only, returns false when key is already in the list (value is not overwritten)
+    bool insert(const leveldb::Slice& key, const leveldb::Slice& val) noexcept(true);
+
+    // writers only, returns false when key is not in the list
+    bool erase(const leveldb::Slice& key) noexcept(true);
+
+    bool get(const leveldb::Slice& key, leveldb::Slice& val) const noexcept(true);
+
+    size_t getRecordsNumber() const noexcept(true)
+    {
+        return recordsNumber.load(std::memory_order_relaxed);
+    }
+
+    // nodes of deleted records are counted as well, they are freed only with the list
+    size_t getNodesNumber() const noexcept(true)
+    {
+        return nodesNumber.load(std::memory_order_relaxed);
+    }
+
+    // writers only
+    size_t getMemoryUsage() const noexcept(true)
+    {
+        return arenaMemoryUsage;
+    }
+
+    DBSkipList() noexcept(true);
+
+    virtual ~DBSkipList() noexcept(true) = default;
+
+    DBSkipList(const DBSkipList&) = delete;
+    DBSkipList(DBSkipList&&) = delete;
+    DBSkipList& operator=(const DBSkipList&) = delete;
+    DBSkipList& operator=(DBSkipList&&) = delete;
+};
+
+// Cursor shares the list, so it stays valid when owner of the list replaces it by a new one
+class DBSkipListCursor : public DBIndexCursor
+{
+private:
+    std::shared_ptr<const DBSkipList> list;
+    DBSkipList::Iterator it;
+
+public:
+    bool isValid() const noexcept(true) override
+    {
+        return it.isValid();
+    }
+
+    void seekToFirst() noexcept(true) override
+    {
+        it.seekToFirst();
+    }
+
+    void seek(const leveldb::Slice& key) noexcept(true) override
+    {
+        it.seek(key);
+    }
+
+    void next() noexcept(true) override
+    {
+        it.next();
+    }
+
+    leveldb::Slice getKey() const noexcept(true) override
+    {
+        return it.getKey();
+    }
+
+    leveldb::Slice getVal() const noexcept(true) override
+    {
+        return it.getVal();
+    }
+
+    explicit DBSkipListCursor(const std::shared_ptr<const DBSkipList>& list)
+    : list{list}, it{list.get()}
+    {
+        it.seekToFirst();
+    }
+
+    virtual ~DBSkipListCursor() noexcept(true) = default;
+
+    DBSkipListCursor() = delete;
+    DBSkipListCursor(const DBSkipListCursor&) = delete;
+    DBSkipListCursor(DBSkipListCursor&&) = delete;
+    DBSkipListCursor& operator=(const DBSkipListCursor&) = delete;
+    DBSkipListCursor& operator=(DBSkipListCursor&&) = delete;
+};
+
+#endif
@@ -4,12 +4,12 @@
 #include <memory>
 #include <thread>
 
-#include <threadPool.hpp>
+#include <dbWorkStealingPool.hpp>
 
 class DBThreadPool
 {
 public:
-    thread_pool threadPool;
+    DBWorkStealingPool threadPool;
     std::mutex mutex;
 
     DBThreadPool(size_t maxThreads) noexcept(true)
@@ -52,5 +52,8 @@ static inline void dbThreadPoolInit()
 // for (auto& task : futures)
 //     task.get();
 
+// fork / join without futures
+// dbThreadPool->threadPool.parallelFor(0, v.size(), [&v](size_t i) { v[i] *= 2; });
+
 
 #endif
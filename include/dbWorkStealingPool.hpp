@@ -0,0 +1,197 @@
+#ifndef DB_WORK_STEALING_POOL_HPP
+#define DB_WORK_STEALING_POOL_HPP
+
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <type_traits>
+#include <exception>
+#include <algorithm>
+
+// Thread pool with one task deque per worker.
+// Worker pushes and pops own tasks at the back (the newest task is hot in cache), idle workers steal from the front of other deques.
+// Tasks submitted from outside of the pool are spread round robin over the deques.
+// Idle workers park on condition variable, so submit wakes a worker at once instead of waiting for a polling timer.
+class DBWorkStealingPool
+{
+public:
+    using Task = std::function<void()>;
+
+private:
+    struct DBWorkerQueue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<DBWorkerQueue>> queues;
+    std::vector<std::thread> workers;
+
+    std::atomic<size_t> nextQueue; // round robin for external submits
+    std::atomic<size_t> queuedTasks; // pushed and not popped yet
+    std::atomic<size_t> unfinishedTasks; // queued or running
+    std::atomic<size_t> parkedWorkers;
+    std::atomic<bool> running;
+
+    std::mutex parkMutex;
+    std::condition_variable parkCv; // workers wait here for tasks
+    std::condition_variable idleCv; // waitForTasks waits here for unfinishedTasks == 0
+
+    bool popTask(size_t queueIndex, Task& task) noexcept(true);
+    bool stealTask(size_t thiefIndex, Task& task) noexcept(true);
+    void runTask(Task& task) noexcept(true);
+    void worker(size_t index) noexcept(true);
+
+public:
+    // fire and forget, task must not throw
+    void post(Task&& task) noexcept(true);
+
+    // f(args...) is run by the pool, function without result gives future<bool> set to true when it is done
+    template <typename F, typename... A, typename R = std::invoke_result_t<std::decay_t<F>, std::decay_t<A>...>>
+    std::future<std::conditional_t<std::is_void_v<R>, bool, R>> submit(const F& task, const A&... args) noexcept(true)
+    {
+        using FutureType = std::conditional_t<std::is_void_v<R>, bool, R>;
+
+        std::shared_ptr<std::promise<FutureType>> taskPromise = std::make_shared<std::promise<FutureType>>();
+        std::future<FutureType> future = taskPromise->get_future();
+        post([task, args..., taskPromise]()
+             {
+                 try
+                 {
+                     if constexpr (std::is_void_v<R>)
+                     {
+                         task(args...);
+                         taskPromise->set_value(true);
+                     }
+                     else
+                         taskPromise->set_value(task(args...));
+                 }
+                 catch (...)
+                 {
+                     taskPromise->set_exception(std::current_exception());
+                 }
+             });
+
+        return future;
+    }
+
+    // f(i) for i in <first, last), range is split into blocks (thread count by default) and the call returns when all of them are done
+    template <typename F>
+    void parallelFor(size_t first, size_t last, const F& f, size_t blocks = 0) noexcept(true);
+
+    // wait until every submitted task is done
+    void waitForTasks() noexcept(true);
+
+    size_t getThreadCount() const noexcept(true)
+    {
+        return workers.size();
+    }
+
+    DBWorkStealingPool(size_t threads) noexcept(true);
+
+    // waits for all submitted tasks
+    virtual ~DBWorkStealingPool() noexcept(true);
+
+    DBWorkStealingPool() = delete;
+    DBWorkStealingPool(const DBWorkStealingPool&) = delete;
+    DBWorkStealingPool(DBWorkStealingPool&&) = delete;
+    DBWorkStealingPool& operator=(const DBWorkStealingPool&) = delete;
+    DBWorkStealingPool& operator=(DBWorkStealingPool&&) = delete;
+};
+
+// Fork / join helper: run() forks task into the pool, wait() joins all of them.
+// Tasks are kept in the group and the pool gets only proxies which run the oldest not started task,
+// so wait() can run not started tasks in the caller. Nested groups make progress even when every worker waits
+// and the caller runs only tasks of its own group (never foreign task that could need locks held by the caller).
+class DBTaskGroup
+{
+private:
+    struct DBTaskGroupState
+    {
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::deque<DBWorkStealingPool::Task> tasks; // not started yet
+        size_t pendingTasks; // not finished yet
+
+        // runs the oldest not started task, false when all of them are started
+        bool runTask() noexcept(true);
+
+        DBTaskGroupState() noexcept(true)
+        : pendingTasks{0}
+        {
+
+        }
+    };
+
+    DBWorkStealingPool& pool;
+    std::shared_ptr<DBTaskGroupState> state; // proxies left in the pool after wait() keep the state alive
+
+public:
+    template <typename F>
+    void run(const F& f) noexcept(true)
+    {
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->tasks.emplace_back(f);
+            ++state->pendingTasks;
+        }
+
+        pool.post([groupState = state]() { groupState->runTask(); });
+    }
+
+    // helps with not started tasks, then waits for the ones run by workers
+    void wait() noexcept(true);
+
+    DBTaskGroup(DBWorkStealingPool& pool) noexcept(true)
+    : pool{pool}, state{std::make_shared<DBTaskGroupState>()}
+    {
+
+    }
+
+    // tasks use caller variables, so group joins them before it is destroyed
+    virtual ~DBTaskGroup() noexcept(true)
+    {
+        wait();
+    }
+
+    DBTaskGroup() = delete;
+    DBTaskGroup(const DBTaskGroup&) = delete;
+    DBTaskGroup(DBTaskGroup&&) = delete;
+    DBTaskGroup& operator=(const DBTaskGroup&) = delete;
+    DBTaskGroup& operator=(DBTaskGroup&&) = delete;
+};
+
+template <typename F>
+void DBWorkStealingPool::parallelFor(const size_t first, const size_t last, const F& f, size_t blocks) noexcept(true)
+{
+    if (last <= first)
+        return;
+
+    if (blocks == 0)
+        blocks = getThreadCount();
+
+    blocks = std::min(blocks, last - first);
+
+    DBTaskGroup group(*this);
+    const size_t blockSize = (last - first) / blocks;
+    for (size_t b = 0; b < blocks; ++b)
+    {
+        const size_t blockFirst = first + b * blockSize;
+        const size_t blockLast = b == blocks - 1 ? last : blockFirst + blockSize;
+        group.run([&f, blockFirst, blockLast]()
+                  {
+                      for (size_t i = blockFirst; i < blockLast; ++i)
+                          f(i);
+                  });
+    }
+
+    group.wait();
+}
+
+#endif
@@ -8,6 +8,7 @@
 #include <leveldb/db.h>
 
 #include <dbRecord.hpp>
+#include <dbFlushPolicy.hpp>
 #include <logger.hpp>
 
 class DBWriteBuffer
@@ -17,15 +18,16 @@ private:
     size_t capacity;
     std::vector<DBRecord> recordsBuffer;
     std::mutex bufferMutex;
+    std::shared_ptr<DBFlushPolicy> flushPolicy;
 
     void do_insert(const DBRecord& record) noexcept(true);
     void do_flush() noexcept(true);
 
 public:
-    DBWriteBuffer(leveldb::DB* db, size_t capacity = 100 * 1000) noexcept(true)
-    : db{db}, capacity{capacity}, recordsBuffer{std::vector<DBRecord>()}, bufferMutex{std::mutex()}
+    DBWriteBuffer(leveldb::DB* db, size_t capacity = 100 * 1000, const std::shared_ptr<DBFlushPolicy>& flushPolicy = std::make_shared<DBCompactRangeFlushPolicy>()) noexcept(true)
+    : db{db}, capacity{capacity}, recordsBuffer{std::vector<DBRecord>()}, bufferMutex{std::mutex()}, flushPolicy{flushPolicy}
     {
-        LOGGER_LOG_DEBUG("DBWriteBuffer created with {} capacity", capacity);
+        LOGGER_LOG_DEBUG("DBWriteBuffer created with {} capacity, flushPolicy: {}", capacity, flushPolicy->getName());
 
         recordsBuffer.reserve(capacity);
     }
@@ -45,11 +47,24 @@ public:
     void insert(const leveldb::Slice& key, const leveldb::Slice& val) noexcept(true);
     void flush() noexcept(true);
 
+    void runDeferredCompaction() noexcept(true)
+    {
+        flushPolicy->runDeferredCompaction(db);
+    }
+
+    DBFlushPolicyStats getFlushPolicyStats() noexcept(true)
+    {
+        return flushPolicy->getStats();
+    }
+
     virtual ~DBWriteBuffer() noexcept(true)
     {
         LOGGER_LOG_DEBUG("DBWriteBuffer destructor current entries:{}/{}, flushing", getNumEntriesInBuffer(), capacity);
 
         flush();
+
+        // compaction postponed by the policy has to run before the owner closes db
+        flushPolicy->beforeClose(db);
     }
 
     // rule of 5 since we have custom destructor
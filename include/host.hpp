@@ -8,6 +8,17 @@ namespace hostPlatform
 extern std::string directorySeparator;
 void flushFileSystemCache();
 
+// read only memory mapping of the whole file, returns nullptr when file cannot be mapped
+const char* mapFile(const std::string& filePath, size_t& fileSize);
+void unmapFile(const char* data, size_t fileSize);
+
+// fsync of the file or directory (directory sync makes renames and new entries durable), returns false on error
+bool syncPath(const std::string& path);
+
+// access pattern hints for mapped memory
+void adviseSequentialAccess(const char* data, size_t length);
+void adviseRandomAccess(const char* data, size_t length);
+
 // LINUX platform
 #ifdef __linux__
 
@@ -0,0 +1,513 @@
+#include <dbAdaptiveLogFile.hpp>
+#include <dbCoding.hpp>
+#include <host.hpp>
+
+#include <iostream>
+#include <iterator>
+#include <algorithm>
+#include <memory>
+
+const leveldb::FilterPolicy* DBAdaptiveLogFile::getFilterPolicy() noexcept(true)
+{
+    // policy is stateless, so all files share one instance
+    static const std::unique_ptr<const leveldb::FilterPolicy> policy(leveldb::NewBloomFilterPolicy(bloomBitsPerKey));
+    return policy.get();
+}
+
+bool DBAdaptiveLogFile::keyMayMatch(const std::string& filter, const leveldb::Slice& key) noexcept(true)
+{
+    if (filter.empty())
+        return true;
+
+    return getFilterPolicy()->KeyMayMatch(key, leveldb::Slice(filter));
+}
+
+void DBAdaptiveLogFileWriter::flushBlock() noexcept(true)
+{
+    if (block.empty())
+        return;
+
+    const uint32_t recordsSize = static_cast<uint32_t>(block.size());
+    const uint32_t keyColumnSize = blockHasKeyColumn ? static_cast<uint32_t>(blockKeyColumn.size()) : 0;
+    block.append(blockKeyColumn.data(), keyColumnSize);
+
+    const uint32_t crc = DBCoding::crc32c(block.data(), block.size());
+    blocks.push_back({fileOffset, recordsSize, keyColumnSize, blockFirstRecordIndex, blockFenceKey});
+
+    DBCoding::putFixed32(block, crc);
+    file.write(block.data(), static_cast<std::streamsize>(block.size()));
+
+    LOGGER_LOG_TRACE("AL file {}: block {} written, offset: {}, size: {}", filePath, blocks.size() - 1, fileOffset, block.size());
+
+    fileOffset += block.size();
+    blockFirstRecordIndex = numRecords;
+    block.clear();
+    blockKeyColumn.clear();
+    blockHasKeyColumn = true;
+}
+
+void DBAdaptiveLogFileWriter::append(const leveldb::Slice& key, const leveldb::Slice& val) noexcept(true)
+{
+    const size_t recordSize = sizeof(uint32_t) + sizeof(uint32_t) + key.size() + val.size();
+    if (!block.empty() && block.size() + recordSize > blockSize)
+        flushBlock();
+
+    if (block.empty())
+        blockFenceKey = key.ToString();
+
+    DBCoding::putFixed32(block, static_cast<uint32_t>(key.size()));
+    DBCoding::putFixed32(block, static_cast<uint32_t>(val.size()));
+    block.append(key.data(), key.size());
+    block.append(val.data(), val.size());
+
+    if (key.size() == DBSecondaryKeyFilter::keySize)
+        blockKeyColumn.append(key.data(), key.size());
+    else
+        blockHasKeyColumn = false;
+
+    filterKeyOffsets.push_back(filterKeys.size());
+    filterKeys.append(key.data(), key.size());
+
+    if (numRecords == 0 || key.compare(leveldb::Slice(minKey)) < 0)
+        minKey = key.ToString();
+
+    if (numRecords > 0 && key.compare(leveldb::Slice(maxKey)) < 0 && sorted)
+    {
+        LOGGER_LOG_WARN("AL file {} is not a sorted run, key {} appended after {}", filePath, key.ToString(), maxKey);
+        sorted = false;
+    }
+
+    if (numRecords == 0 || key.compare(leveldb::Slice(maxKey)) > 0)
+        maxKey = key.ToString();
+
+    ++numRecords;
+}
+
+bool DBAdaptiveLogFileWriter::finish() noexcept(true)
+{
+    finished = true;
+    flushBlock();
+
+    if (numRecords > 0)
+    {
+        std::vector<leveldb::Slice> keys;
+        keys.reserve(filterKeyOffsets.size());
+        for (size_t i = 0; i < filterKeyOffsets.size(); ++i)
+        {
+            const size_t keyEnd = i + 1 < filterKeyOffsets.size() ? filterKeyOffsets[i + 1] : filterKeys.size();
+            keys.push_back(leveldb::Slice(filterKeys.data() + filterKeyOffsets[i], keyEnd - filterKeyOffsets[i]));
+        }
+
+        DBAdaptiveLogFile::getFilterPolicy()->CreateFilter(keys.data(), static_cast<int>(keys.size()), &filter);
+    }
+
+    // keys are not needed anymore
+    filterKeys = std::string();
+    filterKeyOffsets = std::vector<size_t>();
+
+    std::string footer;
+    DBCoding::putFixed32(footer, DBAdaptiveLogFile::formatVersion);
+    footer.push_back(static_cast<char>(sorted ? 1 : 0));
+    DBCoding::putFixed64(footer, numRecords);
+    DBCoding::putLengthPrefixedSlice(footer, leveldb::Slice(minKey));
+    DBCoding::putLengthPrefixedSlice(footer, leveldb::Slice(maxKey));
+    DBCoding::putFixed32(footer, static_cast<uint32_t>(blocks.size()));
+    for (const auto& handle : blocks)
+    {
+        DBCoding::putFixed64(footer, handle.offset);
+        DBCoding::putFixed32(footer, handle.size);
+        DBCoding::putFixed32(footer, handle.keyColumnSize);
+        DBCoding::putFixed64(footer, handle.firstRecordIndex);
+        DBCoding::putLengthPrefixedSlice(footer, leveldb::Slice(handle.fenceKey));
+    }
+    DBCoding::putLengthPrefixedSlice(footer, leveldb::Slice(filter));
+    DBCoding::putFixed32(footer, DBCoding::crc32c(footer.data(), footer.size()));
+
+    std::string trailer;
+    DBCoding::putFixed64(trailer, fileOffset);
+    DBCoding::putFixed32(trailer, static_cast<uint32_t>(footer.size()));
+    DBCoding::putFixed32(trailer, DBAdaptiveLogFile::magic);
+
+    file.write(footer.data(), static_cast<std::streamsize>(footer.size()));
+    file.write(trailer.data(), static_cast<std::streamsize>(trailer.size()));
+    file.close();
+
+    if (file.fail())
+    {
+        std::cerr << "Cannot write AL file: " << filePath << std::endl;
+        return false;
+    }
+
+    LOGGER_LOG_TRACE("AL file {} finished, records: {}, blocks: {}, range: ({}, {})", filePath, numRecords, blocks.size(), minKey, maxKey);
+
+    return true;
+}
+
+DBAdaptiveLogFileReader::DBAdaptiveLogFileReader(const std::string& filePath)
+: filePath{filePath}, fileData{nullptr}, fileSize{0}, mapped{false}, valid{false}, sorted{false}, numRecords{0}
+{
+    fileData = hostPlatform::mapFile(filePath, fileSize);
+    if (fileData != nullptr)
+    {
+        mapped = true;
+
+        // range probes touch only few blocks, full scans switch to sequential access
+        hostPlatform::adviseRandomAccess(fileData, fileSize);
+    }
+    else
+    {
+        std::ifstream file(filePath, std::ios::binary);
+        if (!file.is_open())
+        {
+            std::cerr << "Cannot open AL file: " << filePath << std::endl;
+            return;
+        }
+
+        fileBuffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        fileData = fileBuffer.data();
+        fileSize = fileBuffer.size();
+    }
+
+    valid = readFooter();
+
+    if (!valid)
+        std::cerr << "AL file: " << filePath << " is corrupted" << std::endl;
+}
+
+DBAdaptiveLogFileReader::~DBAdaptiveLogFileReader() noexcept(true)
+{
+    if (mapped)
+        hostPlatform::unmapFile(fileData, fileSize);
+}
+
+bool DBAdaptiveLogFileReader::readFooter() noexcept(true)
+{
+    if (fileSize < DBAdaptiveLogFile::trailerSize)
+        return false;
+
+    const char* const trailer = fileData + fileSize - DBAdaptiveLogFile::trailerSize;
+    const uint64_t footerOffset = DBCoding::decodeFixed64(trailer);
+    const uint32_t footerSize = DBCoding::decodeFixed32(trailer + sizeof(uint64_t));
+    const uint32_t fileMagic = DBCoding::decodeFixed32(trailer + sizeof(uint64_t) + sizeof(uint32_t));
+
+    // checked by subtractions, sums of corrupted values can wrap around
+    if (fileMagic != DBAdaptiveLogFile::magic || footerSize < sizeof(uint32_t) || footerSize > fileSize - DBAdaptiveLogFile::trailerSize || footerOffset != fileSize - DBAdaptiveLogFile::trailerSize - footerSize)
+        return false;
+
+    const char* const footerData = fileData + footerOffset;
+    const size_t footerDataSize = footerSize - sizeof(uint32_t);
+    if (DBCoding::crc32c(footerData, footerDataSize) != DBCoding::decodeFixed32(footerData + footerDataSize))
+        return false;
+
+    leveldb::Slice footer(footerData, footerDataSize);
+    uint32_t version;
+    leveldb::Slice minKeySlice;
+    leveldb::Slice maxKeySlice;
+    uint32_t numBlocks;
+
+    if (!DBCoding::getFixed32(footer, version) || version != DBAdaptiveLogFile::formatVersion || footer.empty())
+        return false;
+
+    sorted = footer[0] != 0;
+    footer.remove_prefix(1);
+
+    if (!DBCoding::getFixed64(footer, numRecords) ||
+        !DBCoding::getLengthPrefixedSlice(footer, minKeySlice) ||
+        !DBCoding::getLengthPrefixedSlice(footer, maxKeySlice) ||
+        !DBCoding::getFixed32(footer, numBlocks))
+        return false;
+
+    minKey = minKeySlice.ToString();
+    maxKey = maxKeySlice.ToString();
+
+    blocks.reserve(numBlocks);
+    for (uint32_t i = 0; i < numBlocks; ++i)
+    {
+        DBAdaptiveLogFile::DBAdaptiveLogFileBlockHandle handle;
+        leveldb::Slice fenceKey;
+        if (!DBCoding::getFixed64(footer, handle.offset) ||
+            !DBCoding::getFixed32(footer, handle.size) ||
+            !DBCoding::getFixed32(footer, handle.keyColumnSize) ||
+            !DBCoding::getFixed64(footer, handle.firstRecordIndex) ||
+            !DBCoding::getLengthPrefixedSlice(footer, fenceKey))
+            return false;
+
+        handle.fenceKey = fenceKey.ToString();
+
+        // block | keyColumn | crc32 has to end before the footer
+        if (footerOffset < sizeof(uint32_t) ||
+            handle.offset > footerOffset - sizeof(uint32_t) ||
+            handle.size > footerOffset - sizeof(uint32_t) - handle.offset ||
+            handle.keyColumnSize > footerOffset - sizeof(uint32_t) - handle.offset - handle.size)
+            return false;
+
+        if (handle.firstRecordIndex > numRecords || (!blocks.empty() && handle.firstRecordIndex < blocks.back().firstRecordIndex))
+            return false;
+
+        blocks.push_back(handle);
+    }
+
+    // keyColumn has to have key of every record in the block
+    for (size_t i = 0; i < blocks.size(); ++i)
+    {
+        const uint64_t blockRecords = (i + 1 < blocks.size() ? blocks[i + 1].firstRecordIndex : numRecords) - blocks[i].firstRecordIndex;
+        if (blocks[i].keyColumnSize != 0 && blocks[i].keyColumnSize != blockRecords * DBSecondaryKeyFilter::keySize)
+            return false;
+    }
+
+    leveldb::Slice filterSlice;
+    if (!DBCoding::getLengthPrefixedSlice(footer, filterSlice))
+        return false;
+
+    filter = filterSlice.ToString();
+
+    return true;
+}
+
+bool DBAdaptiveLogFileReader::forEachRecordInBlock(const size_t blockIndex, const std::function<bool(size_t, const leveldb::Slice&, const leveldb::Slice&)>& f, const DBSecondaryKeyFilter* const keyFilter) const noexcept(true)
+{
+    const DBAdaptiveLogFile::DBAdaptiveLogFileBlockHandle& handle = blocks[blockIndex];
+    const char* const blockData = fileData + handle.offset;
+    const size_t checkedSize = static_cast<size_t>(handle.size) + handle.keyColumnSize;
+    if (DBCoding::crc32c(blockData, checkedSize) != DBCoding::decodeFixed32(blockData + checkedSize))
+    {
+        std::cerr << "AL file: " << filePath << " block at offset " << handle.offset << " has wrong checksum" << std::endl;
+        return false;
+    }
+
+    // filter whole keyColumn at once, block without selected records is not decoded at all
+    std::vector<uint64_t> selection;
+    const bool useKeyColumn = keyFilter != nullptr && handle.keyColumnSize > 0;
+    if (useKeyColumn)
+    {
+        const size_t blockRecords = handle.keyColumnSize / DBSecondaryKeyFilter::keySize;
+        selection.resize((blockRecords + 63) / 64);
+        keyFilter->filter(blockData + handle.size, blockRecords, selection.data());
+
+        if (std::all_of(std::begin(selection), std::end(selection), [](uint64_t bits) { return bits == 0; }))
+            return true;
+    }
+
+    leveldb::Slice input(blockData, handle.size);
+    size_t recordIndex = handle.firstRecordIndex;
+    while (!input.empty())
+    {
+        uint32_t keySize;
+        uint32_t valSize;
+        if (!DBCoding::getFixed32(input, keySize) || !DBCoding::getFixed32(input, valSize) || input.size() < static_cast<size_t>(keySize) + valSize)
+            return false;
+
+        const leveldb::Slice key(input.data(), keySize);
+        const leveldb::Slice val(input.data() + keySize, valSize);
+        input.remove_prefix(static_cast<size_t>(keySize) + valSize);
+
+        const size_t blockRecordIndex = recordIndex - handle.firstRecordIndex;
+        if (useKeyColumn && ((selection[blockRecordIndex / 64] >> (blockRecordIndex % 64)) & 1) == 0)
+        {
+            ++recordIndex;
+            continue;
+        }
+
+        if (!f(recordIndex, key, val))
+            break;
+
+        ++recordIndex;
+    }
+
+    return true;
+}
+
+bool DBAdaptiveLogFileReader::forEachRecord(const RecordCallback& f) const noexcept(true)
+{
+    if (!valid)
+        return false;
+
+    if (mapped && !blocks.empty())
+        hostPlatform::adviseSequentialAccess(fileData, blocks.back().offset + blocks.back().size + sizeof(uint32_t));
+
+    const auto allRecordsF =    [&f](size_t recordIndex, const leveldb::Slice& key, const leveldb::Slice& val) -> bool
+                                {
+                                    f(recordIndex, key, val);
+                                    return true;
+                                };
+
+    for (size_t i = 0; i < blocks.size(); ++i)
+        if (!forEachRecordInBlock(i, allRecordsF))
+            return false;
+
+    return true;
+}
+
+bool DBAdaptiveLogFileReader::forEachRecordInRange(const leveldb::Slice& rangeMinKey, const leveldb::Slice& rangeMaxKey, const RecordCallback& f) const noexcept(true)
+{
+    if (!valid)
+        return false;
+
+    if (rangeMinKey.compare(rangeMaxKey) > 0)
+        return true;
+
+    // unsorted file has no usable fences, we need to scan everything
+    size_t firstBlock = 0;
+    if (sorted)
+    {
+        // first block with fence >= minKey, the previous block can still end with keys >= minKey
+        const auto it = std::lower_bound(std::begin(blocks), std::end(blocks), rangeMinKey,
+                                         [](const DBAdaptiveLogFile::DBAdaptiveLogFileBlockHandle& handle, const leveldb::Slice& key)
+                                         {
+                                             return leveldb::Slice(handle.fenceKey).compare(key) < 0;
+                                         });
+        firstBlock = it == std::begin(blocks) ? 0 : static_cast<size_t>(std::distance(std::begin(blocks), it)) - 1;
+    }
+
+    // blocks with keyColumn are prefiltered by the SIMD kernel, so rangeRecordsF compares only selected records
+    const DBSecondaryKeyFilter keyFilter(rangeMinKey, rangeMaxKey);
+
+    bool rangeEnd = false;
+    const auto rangeRecordsF =  [this, &f, &rangeMinKey, &rangeMaxKey, &rangeEnd](size_t recordIndex, const leveldb::Slice& key, const leveldb::Slice& val) -> bool
+                                {
+                                    if (key.compare(rangeMinKey) < 0)
+                                        return true;
+
+                                    if (key.compare(rangeMaxKey) > 0)
+                                    {
+                                        rangeEnd = sorted;
+                                        return !rangeEnd;
+                                    }
+
+                                    f(recordIndex, key, val);
+                                    return true;
+                                };
+
+    for (size_t i = firstBlock; i < blocks.size() && !rangeEnd; ++i)
+    {
+        if (sorted && leveldb::Slice(blocks[i].fenceKey).compare(rangeMaxKey) > 0)
+            break;
+
+        if (!forEachRecordInBlock(i, rangeRecordsF, &keyFilter))
+            return false;
+    }
+
+    LOGGER_LOG_TRACE("AL file {}: range ({}, {}) probe started from block {}/{}", filePath, rangeMinKey.ToString(), rangeMaxKey.ToString(), firstBlock, blocks.size());
+
+    return true;
+}
+
+bool DBAdaptiveLogFileReader::getKey(const size_t recordIndex, std::string& key) const noexcept(true)
+{
+    if (!valid || recordIndex >= numRecords)
+        return false;
+
+    // last block with firstRecordIndex <= recordIndex
+    const auto it = std::upper_bound(std::begin(blocks), std::end(blocks), recordIndex,
+                                     [](size_t index, const DBAdaptiveLogFile::DBAdaptiveLogFileBlockHandle& handle)
+                                     {
+                                         return index < handle.firstRecordIndex;
+                                     });
+    if (it == std::begin(blocks))
+        return false;
+
+    bool found = false;
+    const auto getKeyF =    [recordIndex, &key, &found](size_t index, const leveldb::Slice& rKey, const leveldb::Slice&) -> bool
+                            {
+                                if (index != recordIndex)
+                                    return true;
+
+                                key = rKey.ToString();
+                                found = true;
+                                return false;
+                            };
+
+    return forEachRecordInBlock(static_cast<size_t>(std::distance(std::begin(blocks), it)) - 1, getKeyF) && found;
+}
+
+void DBAdaptiveLogFileCursor::loadNextBlock() noexcept(true)
+{
+    records.clear();
+    pos = 0;
+
+    const auto untouchedRecordsF =  [this](size_t recordIndex, const leveldb::Slice& key, const leveldb::Slice& val) -> bool
+                                    {
+                                        if (touchedEntries.empty() || touchedEntries[recordIndex] == 0)
+                                            records.emplace_back(key, val);
+
+                                        return true;
+                                    };
+
+    // blocks with only touched records are skipped
+    while (records.empty() && nextBlock < alFile->blocks.size())
+        if (!alFile->forEachRecordInBlock(nextBlock++, untouchedRecordsF))
+        {
+            // corrupted block ends the file
+            records.clear();
+            nextBlock = alFile->blocks.size();
+        }
+}
+
+void DBAdaptiveLogFileCursor::loadAllBlocks() noexcept(true)
+{
+    std::vector<std::pair<leveldb::Slice, leveldb::Slice>> allRecords;
+    if (alFile->isValid())
+        while (nextBlock < alFile->blocks.size())
+        {
+            loadNextBlock();
+            allRecords.insert(std::end(allRecords), std::begin(records), std::end(records));
+        }
+
+    std::stable_sort(std::begin(allRecords), std::end(allRecords),
+                     [](const std::pair<leveldb::Slice, leveldb::Slice>& a, const std::pair<leveldb::Slice, leveldb::Slice>& b)
+                     {
+                         return a.first.compare(b.first) < 0;
+                     });
+
+    records = std::move(allRecords);
+    pos = 0;
+}
+
+void DBAdaptiveLogFileCursor::seekToFirst() noexcept(true)
+{
+    pos = 0;
+    if (!alFile->isSorted())
+        return;
+
+    nextBlock = alFile->isValid() ? 0 : alFile->blocks.size();
+    loadNextBlock();
+}
+
+void DBAdaptiveLogFileCursor::seek(const leveldb::Slice& key) noexcept(true)
+{
+    if (!alFile->isSorted())
+    {
+        const auto it = std::lower_bound(std::begin(records), std::end(records), key,
+                                         [](const std::pair<leveldb::Slice, leveldb::Slice>& record, const leveldb::Slice& k)
+                                         {
+                                             return record.first.compare(k) < 0;
+                                         });
+        pos = static_cast<size_t>(std::distance(std::begin(records), it));
+        return;
+    }
+
+    if (!alFile->isValid())
+    {
+        seekToFirst();
+        return;
+    }
+
+    // first block with fence >= key, the previous block can still end with keys >= key
+    const auto it = std::lower_bound(std::begin(alFile->blocks), std::end(alFile->blocks), key,
+                                     [](const DBAdaptiveLogFile::DBAdaptiveLogFileBlockHandle& handle, const leveldb::Slice& k)
+                                     {
+                                         return leveldb::Slice(handle.fenceKey).compare(k) < 0;
+                                     });
+    nextBlock = it == std::begin(alFile->blocks) ? 0 : static_cast<size_t>(std::distance(std::begin(alFile->blocks), it)) - 1;
+    loadNextBlock();
+
+    while (isValid() && getKey().compare(key) < 0)
+        next();
+}
+
+void DBAdaptiveLogFileCursor::next() noexcept(true)
+{
+    ++pos;
+    if (pos >= records.size() && alFile->isSorted())
+        loadNextBlock();
+}
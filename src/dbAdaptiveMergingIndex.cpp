@@ -1,10 +1,18 @@
 #include <dbAdaptiveMergingIndex.hpp>
 #include <dbThreadPool.hpp>
 #include <dbDumper.hpp>
+#include <dbAdaptiveLogFile.hpp>
+#include <dbCoding.hpp>
 #include <host.hpp>
 
-#include <fstream>
 #include <iostream>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <filesystem>
+#include <chrono>
+#include <thread>
+#include <set>
 
 std::vector<std::reference_wrapper<DBAdaptiveMergingIndex::DBAdaptiveLog::DBAdaptiveLogEntry>> DBAdaptiveMergingIndex::DBAdaptiveLog::getALLogEntriesForRange(const std::string& minKey, const std::string& maxKey) noexcept(true)
 {
@@ -12,12 +20,21 @@ std::vector<std::reference_wrapper<DBAdaptiveMergingIndex::DBAdaptiveLog::DBAdap
         return std::vector<std::reference_wrapper<DBAdaptiveMergingIndex::DBAdaptiveLog::DBAdaptiveLogEntry>>();
 
     std::vector<std::reference_wrapper<DBAdaptiveMergingIndex::DBAdaptiveLog::DBAdaptiveLogEntry>> ret;
-    for (auto& alFile : alFiles)
+    for (const size_t fileId : alFilesIndex.query(minKey, maxKey))
     {
-        LOGGER_LOG_TRACE("Checking file {}, !{} && {} <= {} && {} >= {}", alFile.filePath, alFile.shouldBeDeleted, minKey, alFile.maxKey, maxKey, alFile.minKey);
-        if (!alFile.shouldBeDeleted && minKey <= alFile.maxKey && maxKey >= alFile.minKey)
+        DBAdaptiveMergingIndex::DBAdaptiveLog::DBAdaptiveLogEntry& alFile = alFiles.at(fileId);
+        std::lock_guard<std::mutex> entryLock(*alFile.entryMutex);
+
+        // point probe, bloom filter can tell us that key is not in this file without any IO
+        if (minKey == maxKey && !DBAdaptiveLogFile::keyMayMatch(alFile.bloomFilter, leveldb::Slice(minKey)))
+        {
+            LOGGER_LOG_TRACE("Skip file {}, key {} filtered out by bloom filter", alFile.filePath, minKey);
+            continue;
+        }
+
+        if (!alFile.shouldBeDeleted)
         {
-            LOGGER_LOG_TRACE("Add file {} to range overlap files", alFile.filePath);
+            LOGGER_LOG_TRACE("Add file {} <{},{}> to range overlap files", alFile.filePath, alFile.minKey, alFile.maxKey);
             ret.push_back(alFile);
         }
     }
@@ -25,75 +42,612 @@ std::vector<std::reference_wrapper<DBAdaptiveMergingIndex::DBAdaptiveLog::DBAdap
     return ret;
 }
 
+void DBAdaptiveMergingIndex::DBAdaptiveLog::addAlFile(const DBAdaptiveMergingIndex::DBAdaptiveLog::DBAdaptiveLogEntry& alLog) noexcept(true)
+{
+    alFiles.insert_or_assign(alLog.fileId, alLog);
+    if (!alLog.shouldBeDeleted)
+        alFilesIndex.insert(alLog.fileId, alLog.minKey, alLog.maxKey);
+}
 
-void DBAdaptiveMergingIndex::DBAdaptiveLog::copyPrimIndexIntoAl() noexcept(true)
+void DBAdaptiveMergingIndex::DBAdaptiveLog::updateAlFilesIndex(const std::vector<size_t>& fileIds) noexcept(true)
 {
-    // get primaryIndex ssTables
-    std::vector<std::vector<std::string>> ssTables = DBDumper::getSSTableFiles(primaryIndex->getLevelDbPtr(), primaryIndex->getIndexFolder());
+    // tasks could change key ranges, index is not thread safe so it is updated after tasks
+    for (const size_t fileId : fileIds)
+    {
+        // file could be already removed by concurrent search
+        const auto it = alFiles.find(fileId);
+        if (it == std::end(alFiles))
+            continue;
+
+        if (it->second.shouldBeDeleted)
+            alFilesIndex.erase(fileId);
+        else
+            alFilesIndex.update(fileId, it->second.minKey, it->second.maxKey);
+    }
+}
 
-    const auto singleSSTableCopyF = [this](const std::string& ssTable, const std::string& outFile, size_t vecIndex) -> void
-                                    {
-                                        // dump SSTable to get vector of records
-                                        const std::vector<DBRecord> ssTableRecords = DBDumper::dumpSSTable(ssTable);
 
+void DBAdaptiveMergingIndex::DBAdaptiveLog::updateAlLogEntryKeyRange(DBAdaptiveMergingIndex::DBAdaptiveLog::DBAdaptiveLogEntry& alLog, const DBAdaptiveLogFileReader& alFile) noexcept(true)
+{
+    const auto firstValid = std::find(std::begin(alLog.touchedEntries), std::end(alLog.touchedEntries), 0);
+    if (firstValid == std::end(alLog.touchedEntries))
+    {
+        alLog.shouldBeDeleted = true;
+        return;
+    }
+
+    if (alFile.isSorted())
+    {
+        // sorted run: first and last untouched records are the new bounds
+        const auto lastValid = std::find(std::rbegin(alLog.touchedEntries), std::rend(alLog.touchedEntries), 0);
+        alFile.getKey(static_cast<size_t>(std::distance(std::begin(alLog.touchedEntries), firstValid)), alLog.minKey);
+        alFile.getKey(static_cast<size_t>(std::distance(lastValid, std::rend(alLog.touchedEntries))) - 1, alLog.maxKey);
+    }
+    else
+    {
+        std::vector<std::string> validKeys;
+        alFile.forEachRecord([&alLog, &validKeys](size_t i, const leveldb::Slice& rKey, const leveldb::Slice&)
+        {
+            if (alLog.touchedEntries[i] == 0)
+                validKeys.push_back(rKey.ToString());
+        });
+
+        alLog.minKey = *std::min_element(std::begin(validKeys), std::end(validKeys));
+        alLog.maxKey = *std::max_element(std::begin(validKeys), std::end(validKeys));
+    }
+
+    LOGGER_LOG_TRACE("alLog {} new range: <{},{}>", alLog.filePath, alLog.minKey, alLog.maxKey);
+}
+
+void DBAdaptiveMergingIndex::DBAdaptiveLog::rewriteAlFile(DBAdaptiveMergingIndex::DBAdaptiveLog::DBAdaptiveLogEntry& alLog, const DBAdaptiveLogFileReader& alFile) noexcept(true)
+{
+    // empty file will be removed by removeDeletedAlFiles, nothing to rewrite
+    if (alLog.shouldBeDeleted || alLog.numRecordsInFile == 0)
+        return;
+
+    const size_t liveRecords = alLog.numRecordsInFile - alLog.numTouchedEntries;
+    if (static_cast<double>(liveRecords) >= alRewriteThreshold * static_cast<double>(alLog.numRecordsInFile))
+        return;
+
+    LOGGER_LOG_DEBUG("Rewriting AL file {}, live records {} / {}", alLog.filePath, liveRecords, alLog.numRecordsInFile);
+
+    // copy only untouched records to the new file, file order is kept so sorted run stays sorted
+    // old file is referenced by the last manifest, so it is removed when the next one is saved
+    // live records drop with every rewrite, so the name is unique for this entry
+    const std::string newFilePath = alFolderPath + hostPlatform::directorySeparator + std::to_string(alLog.fileId) + std::string("_") + std::to_string(liveRecords) + std::string(".alf");
+    std::string newBloomFilter;
+    {
+        DBAdaptiveLogFileWriter newAlFile(newFilePath);
+        alFile.forEachRecord([&alLog, &newAlFile](size_t i, const leveldb::Slice& rKey, const leveldb::Slice& rVal)
+        {
+            if (alLog.touchedEntries[i] == 0)
+                newAlFile.append(rKey, rVal);
+        });
+
+        if (!newAlFile.finish() || newAlFile.getNumRecords() != liveRecords)
+        {
+            std::cerr << "Cannot rewrite AL file " << alLog.filePath << std::endl;
+            std::error_code ec;
+            std::filesystem::remove(newFilePath, ec);
+            return;
+        }
+
+        newBloomFilter = newAlFile.getFilter();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(obsoleteAlFilesMutex);
+        obsoleteAlFiles.push_back(alLog.filePath);
+    }
+
+    alLog.filePath = newFilePath;
+    alLog.numRecordsInFile = liveRecords;
+    alLog.touchedEntries = std::vector<uint8_t>(liveRecords, 0);
+    alLog.numTouchedEntries = 0;
+    alLog.bloomFilter = newBloomFilter;
+}
+
+void DBAdaptiveMergingIndex::DBAdaptiveLog::removeDeletedAlFiles() noexcept(true)
+{
+    for (auto it = std::begin(alFiles); it != std::end(alFiles);)
+    {
+        const DBAdaptiveMergingIndex::DBAdaptiveLog::DBAdaptiveLogEntry& alLog = it->second;
+        if (!alLog.shouldBeDeleted)
+        {
+            ++it;
+            continue;
+        }
+
+        LOGGER_LOG_DEBUG("Removing empty AL file {}", alLog.filePath);
+
+        // file is still referenced by the last manifest
+        {
+            std::lock_guard<std::mutex> lock(obsoleteAlFilesMutex);
+            obsoleteAlFiles.push_back(alLog.filePath);
+        }
+
+        alFilesIndex.erase(alLog.fileId);
+        it = alFiles.erase(it);
+    }
+}
+
+bool DBAdaptiveMergingIndex::DBAdaptiveLog::saveManifest(const bool closed) noexcept(true)
+{
+    std::string manifest;
+    DBCoding::putFixed32(manifest, manifestMagic);
+    DBCoding::putFixed32(manifest, manifestVersion);
+    DBCoding::putFixed64(manifest, ++manifestSequence);
+    DBCoding::putFixed64(manifest, newFileId);
+    DBCoding::putFixed64(manifest, secIndexRecordsNumber);
+    DBCoding::putFixed64(manifest, primaryRecordsNumber);
+    DBCoding::putFixed64(manifest, primaryChecksum);
+    manifest.push_back(static_cast<char>((closed ? manifestFlagClosed : 0) | (ownRecords ? manifestFlagOwnRecords : 0)));
+    DBCoding::putFixed32(manifest, static_cast<uint32_t>(alFiles.size()));
+
+    for (const auto& alFile : alFiles)
+    {
+        const DBAdaptiveMergingIndex::DBAdaptiveLog::DBAdaptiveLogEntry& alLog = alFile.second;
+
+        // touched entries are packed to bits, manifest is rewritten as a whole so it should be small
+        std::string touchedBitmap((alLog.touchedEntries.size() + 7) / 8, '\0');
+        for (size_t i = 0; i < alLog.touchedEntries.size(); ++i)
+            if (alLog.touchedEntries[i] != 0)
+                touchedBitmap[i / 8] = static_cast<char>(static_cast<uint8_t>(touchedBitmap[i / 8]) | (1u << (i % 8)));
+
+        DBCoding::putFixed64(manifest, alLog.fileId);
+        DBCoding::putLengthPrefixedSlice(manifest, std::filesystem::path(alLog.filePath).filename().string());
+        DBCoding::putLengthPrefixedSlice(manifest, alLog.minKey);
+        DBCoding::putLengthPrefixedSlice(manifest, alLog.maxKey);
+        DBCoding::putFixed64(manifest, alLog.numRecordsInFile);
+        DBCoding::putFixed64(manifest, alLog.numTouchedEntries);
+        manifest.push_back(alLog.shouldBeDeleted ? 1 : 0);
+        DBCoding::putLengthPrefixedSlice(manifest, touchedBitmap);
+    }
+
+    DBCoding::putFixed32(manifest, DBCoding::crc32c(manifest.data(), manifest.size()));
+
+    // files referenced by the manifest have to be on disk before the manifest itself
+    for (const auto& alFile : alFiles)
+        if (!hostPlatform::syncPath(alFile.second.filePath))
+            return false;
+
+    // write new version aside and rename it, so the old manifest stays valid until the new one is complete
+    const std::string manifestPath = alFolderPath + hostPlatform::directorySeparator + std::string(manifestFileName);
+    const std::string tmpManifestPath = manifestPath + std::string(".tmp");
+    {
+        std::ofstream manifestFile(tmpManifestPath, std::ios::binary | std::ios::trunc);
+        manifestFile.write(manifest.data(), static_cast<std::streamsize>(manifest.size()));
+        manifestFile.flush();
+        if (!manifestFile.good())
+        {
+            std::cerr << "Cannot write AL manifest " << tmpManifestPath << std::endl;
+            return false;
+        }
+    }
+
+    // content of the new manifest and directory entries of AL files are durable before the rename,
+    // otherwise rename could survive a crash while the data does not
+    if (!hostPlatform::syncPath(tmpManifestPath) || !hostPlatform::syncPath(alFolderPath))
+        return false;
+
+    std::error_code ec;
+    std::filesystem::rename(tmpManifestPath, manifestPath, ec);
+    if (ec)
+    {
+        std::cerr << "Cannot replace AL manifest " << manifestPath << ": " << ec.message() << std::endl;
+        return false;
+    }
+
+    // make the rename itself durable
+    if (!hostPlatform::syncPath(alFolderPath))
+        return false;
+
+    LOGGER_LOG_DEBUG("AL manifest {} saved, sequence: {}, files: {}, closed: {}", manifestPath, manifestSequence, alFiles.size(), closed);
+
+    return true;
+}
+
+bool DBAdaptiveMergingIndex::DBAdaptiveLog::loadManifest() noexcept(true)
+{
+    const std::string manifestPath = alFolderPath + hostPlatform::directorySeparator + std::string(manifestFileName);
+    if (!std::filesystem::exists(manifestPath))
+    {
+        LOGGER_LOG_DEBUG("AL manifest {} not found", manifestPath);
+        return false;
+    }
+
+    std::ifstream manifestFile(manifestPath, std::ios::binary);
+    const std::string manifest((std::istreambuf_iterator<char>(manifestFile)), std::istreambuf_iterator<char>());
+
+    if (manifest.size() < sizeof(uint32_t) || DBCoding::decodeFixed32(manifest.data() + manifest.size() - sizeof(uint32_t)) != DBCoding::crc32c(manifest.data(), manifest.size() - sizeof(uint32_t)))
+    {
+        LOGGER_LOG_WARN("AL manifest {} is corrupted", manifestPath);
+        return false;
+    }
+
+    leveldb::Slice input(manifest.data(), manifest.size() - sizeof(uint32_t));
+
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sequence;
+    uint64_t fileId;
+    uint64_t manifestSecIndexRecordsNumber;
+    uint64_t manifestPrimaryRecordsNumber;
+    uint64_t manifestPrimaryChecksum;
+    uint8_t flags;
+    uint32_t numEntries;
+    if (!DBCoding::getFixed32(input, magic) || magic != manifestMagic ||
+        !DBCoding::getFixed32(input, version) || version != manifestVersion ||
+        !DBCoding::getFixed64(input, sequence) ||
+        !DBCoding::getFixed64(input, fileId) ||
+        !DBCoding::getFixed64(input, manifestSecIndexRecordsNumber) ||
+        !DBCoding::getFixed64(input, manifestPrimaryRecordsNumber) ||
+        !DBCoding::getFixed64(input, manifestPrimaryChecksum) ||
+        input.size() < 1)
+    {
+        LOGGER_LOG_WARN("AL manifest {} has unsupported format", manifestPath);
+        return false;
+    }
+
+    flags = static_cast<uint8_t>(input[0]);
+    input.remove_prefix(1);
+
+    if (!DBCoding::getFixed32(input, numEntries))
+    {
+        LOGGER_LOG_WARN("AL manifest {} is truncated", manifestPath);
+        return false;
+    }
+
+    std::vector<DBAdaptiveMergingIndex::DBAdaptiveLog::DBAdaptiveLogEntry> manifestAlFiles;
+    manifestAlFiles.reserve(numEntries);
+    size_t manifestAlRecordsNumber = 0;
+
+    for (uint32_t e = 0; e < numEntries; ++e)
+    {
+        uint64_t alFileId;
+        leveldb::Slice fileName;
+        leveldb::Slice minKey;
+        leveldb::Slice maxKey;
+        uint64_t numRecords;
+        uint64_t numTouched;
+        leveldb::Slice touchedBitmap;
+        if (!DBCoding::getFixed64(input, alFileId) ||
+            !DBCoding::getLengthPrefixedSlice(input, fileName) ||
+            !DBCoding::getLengthPrefixedSlice(input, minKey) ||
+            !DBCoding::getLengthPrefixedSlice(input, maxKey) ||
+            !DBCoding::getFixed64(input, numRecords) ||
+            !DBCoding::getFixed64(input, numTouched) ||
+            input.size() < 1)
+        {
+            LOGGER_LOG_WARN("AL manifest {} is truncated", manifestPath);
+            return false;
+        }
+
+        const bool shouldBeDeleted = input[0] != 0;
+        input.remove_prefix(1);
+
+        if (!DBCoding::getLengthPrefixedSlice(input, touchedBitmap) || touchedBitmap.size() != (numRecords + 7) / 8 || numTouched > numRecords)
+        {
+            LOGGER_LOG_WARN("AL manifest {} is truncated", manifestPath);
+            return false;
+        }
+
+        DBAdaptiveMergingIndex::DBAdaptiveLog::DBAdaptiveLogEntry alLog(alFileId, alFolderPath + hostPlatform::directorySeparator + fileName.ToString(), minKey.ToString(), maxKey.ToString(), numRecords);
+        for (size_t i = 0; i < numRecords; ++i)
+            alLog.touchedEntries[i] = (static_cast<uint8_t>(touchedBitmap[i / 8]) >> (i % 8)) & 1;
+
+        alLog.numTouchedEntries = numTouched;
+        alLog.shouldBeDeleted = shouldBeDeleted;
+
+        // manifest has to describe files which are really on the disk
+        if (!shouldBeDeleted)
+        {
+            const DBAdaptiveLogFileReader alFile(alLog.filePath);
+            if (!alFile.isValid() || alFile.getNumRecords() != numRecords)
+            {
+                LOGGER_LOG_WARN("AL manifest {} does not match file {}", manifestPath, alLog.filePath);
+                return false;
+            }
+
+            manifestAlRecordsNumber += numRecords - numTouched;
+            alLog.bloomFilter = alFile.getFilter();
+        }
+
+        manifestAlFiles.push_back(alLog);
+    }
+
+    alFiles.clear();
+    alFilesIndex.clear();
+    for (const auto& alLog : manifestAlFiles)
+        addAlFile(alLog);
+
+    alRecordsNumber = manifestAlRecordsNumber;
+    newFileId = fileId;
+    manifestSequence = sequence;
+    secIndexRecordsNumber = manifestSecIndexRecordsNumber;
+    primaryRecordsNumber = manifestPrimaryRecordsNumber;
+    primaryChecksum = manifestPrimaryChecksum;
+    ownRecords = (flags & manifestFlagOwnRecords) != 0;
+    restoredAfterCrash = (flags & manifestFlagClosed) == 0;
+
+    // files written after this manifest (rewrites, flushes not followed by a manifest) are not part of AL
+    removeUnreferencedAlFiles();
+
+    return true;
+}
+
+void DBAdaptiveMergingIndex::DBAdaptiveLog::checkpoint(const bool closed) noexcept(true)
+{
+    removeDeletedAlFiles();
+
+    // old manifest stays until the new one is saved, so files it references are kept till then
+    if (saveManifest(closed))
+        removeObsoleteAlFiles();
+}
+
+void DBAdaptiveMergingIndex::DBAdaptiveLog::removeObsoleteAlFiles() noexcept(true)
+{
+    std::lock_guard<std::mutex> lock(obsoleteAlFilesMutex);
+    for (const auto& filePath : obsoleteAlFiles)
+    {
+        std::error_code ec;
+        std::filesystem::remove(filePath, ec);
+        if (ec)
+            std::cerr << "Cannot remove AL file " << filePath << ": " << ec.message() << std::endl;
+    }
+
+    obsoleteAlFiles.clear();
+}
+
+void DBAdaptiveMergingIndex::DBAdaptiveLog::removeUnreferencedAlFiles() noexcept(true)
+{
+    std::set<std::string> referencedFiles;
+    for (const auto& alFile : alFiles)
+        referencedFiles.insert(std::filesystem::path(alFile.second.filePath).filename().string());
+
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(alFolderPath, ec))
+    {
+        const std::string fileName = entry.path().filename().string();
+        if (!entry.is_regular_file() || fileName == manifestFileName || referencedFiles.count(fileName) > 0)
+            continue;
+
+        LOGGER_LOG_DEBUG("Removing AL file {} not referenced by the manifest", entry.path().string());
+        std::error_code removeEc;
+        std::filesystem::remove(entry.path(), removeEc);
+    }
+}
+
+void DBAdaptiveMergingIndex::DBAdaptiveLog::removeAllAlFiles() noexcept(true)
+{
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(alFolderPath, ec))
+        if (entry.is_regular_file())
+            std::filesystem::remove(entry.path(), ec);
+
+    alFiles.clear();
+    alFilesIndex.clear();
+    alRecordsNumber = 0;
+    newFileId = 0;
+
+    std::lock_guard<std::mutex> lock(obsoleteAlFilesMutex);
+    obsoleteAlFiles.clear();
+}
+
+void DBAdaptiveMergingIndex::DBAdaptiveLog::persist(const size_t secIndexRecordsNumber, const bool closed) noexcept(true)
+{
+    std::lock_guard<std::shared_mutex> lock(alMutex);
+
+    flushRamBuffer();
+    this->secIndexRecordsNumber = secIndexRecordsNumber;
+    checkpoint(closed);
+    checkpointNeeded = false;
+}
+
+void DBAdaptiveMergingIndex::DBAdaptiveLog::getPrimaryIndexChecksum(size_t& recordsNumber, uint64_t& checksum) noexcept(true)
+{
+    // sum of record hashes does not depend on the order, so partitions are summed up separately
+    const size_t maxPartitions = std::max(dbThreadPool->threadPool.getThreadCount(), static_cast<size_t>(1));
+    std::vector<size_t> partitionRecords(maxPartitions, 0);
+    std::vector<uint64_t> partitionChecksums(maxPartitions, 0);
+
+    primaryIndex->forEachRecordParallel(maxPartitions, [&partitionRecords, &partitionChecksums](size_t partition, const leveldb::Slice& key, const leveldb::Slice& val)
+    {
+        ++partitionRecords[partition];
+        partitionChecksums[partition] += (static_cast<uint64_t>(DBCoding::crc32c(key.data(), key.size())) << 32) | DBCoding::crc32c(val.data(), val.size());
+
+        return true;
+    });
+
+    recordsNumber = 0;
+    checksum = 0;
+    for (size_t p = 0; p < maxPartitions; ++p)
+    {
+        recordsNumber += partitionRecords[p];
+        checksum += partitionChecksums[p];
+    }
+}
+
+bool DBAdaptiveMergingIndex::DBAdaptiveLog::matchesPrimaryIndex() noexcept(true)
+{
+    size_t currentRecordsNumber;
+    uint64_t currentChecksum;
+    getPrimaryIndexChecksum(currentRecordsNumber, currentChecksum);
+
+    LOGGER_LOG_DEBUG("PrimaryIndex records: {} checksum: {}, AL copied from records: {} checksum: {}", currentRecordsNumber, currentChecksum, primaryRecordsNumber, primaryChecksum);
+
+    return currentRecordsNumber == primaryRecordsNumber && currentChecksum == primaryChecksum;
+}
+
+void DBAdaptiveMergingIndex::DBAdaptiveLog::rebuild(const std::function<bool(const leveldb::Slice&)>& skipRecord) noexcept(true)
+{
+    std::lock_guard<std::shared_mutex> lock(alMutex);
+
+    removeAllAlFiles();
+    copyPrimIndexIntoAl(skipRecord);
+    getPrimaryIndexChecksum(primaryRecordsNumber, primaryChecksum);
+
+    // AL is a copy of primaryIndex again, skipped records are in secondaryIndex and came from primaryIndex as well
+    ownRecords = false;
+    restoredFromManifest = false;
+    restoredAfterCrash = false;
+    checkpoint(false);
+
+    LOGGER_LOG_DEBUG("PrimaryIndex copied to DBAdaptiveMergingIndex::DBAdaptiveLog, ready to use");
+}
+
+void DBAdaptiveMergingIndex::DBAdaptiveLog::removeRecordsFoundIn(DBIndex& secIndex) noexcept(true)
+{
+    std::lock_guard<std::shared_mutex> lock(alMutex);
+
+    std::vector<size_t> fileIds;
+    size_t removedRecords = 0;
+    for (auto& alFile : alFiles)
+    {
+        DBAdaptiveMergingIndex::DBAdaptiveLog::DBAdaptiveLogEntry& alLog = alFile.second;
+        if (alLog.shouldBeDeleted)
+            continue;
+
+        const DBAdaptiveLogFileReader alFileReader(alLog.filePath);
+        const size_t touchedBefore = alLog.numTouchedEntries;
+        alFileReader.forEachRecord([&alLog, &secIndex](size_t i, const leveldb::Slice& rKey, const leveldb::Slice&)
+        {
+            if (alLog.touchedEntries[i] == 0 && secIndex.psearch(rKey.ToString()).size() > 0)
+            {
+                alLog.touchedEntries[i] = 1;
+                ++alLog.numTouchedEntries;
+            }
+        });
+
+        if (alLog.numTouchedEntries == touchedBefore)
+            continue;
+
+        removedRecords += alLog.numTouchedEntries - touchedBefore;
+        updateAlLogEntryKeyRange(alLog, alFileReader);
+        rewriteAlFile(alLog, alFileReader);
+        fileIds.push_back(alLog.fileId);
+    }
+
+    alRecordsNumber -= removedRecords;
+    updateAlFilesIndex(fileIds);
+    checkpoint(false);
+
+    LOGGER_LOG_DEBUG("Removed {} AL records already merged into secondaryIndex", removedRecords);
+}
+
+void DBAdaptiveMergingIndex::DBAdaptiveLog::copyPrimIndexIntoAl(const std::function<bool(const leveldb::Slice&)>& skipRecord) noexcept(true)
+{
+    // AL is copied from SSTable files, records still in the buffer or in the memtable (non compacting flush policies) would be lost
+    primaryIndex->flushToSSTables();
+
+    // get primaryIndex ssTables, the largest first, so a big file does not start last and set the finish time
+    std::vector<DBSSTableInfo> ssTables = DBDumper::getSSTablesInfo(primaryIndex->getLevelDbPtr(), primaryIndex->getIndexFolder());
+    std::sort(std::begin(ssTables), std::end(ssTables), [](const DBSSTableInfo& a, const DBSSTableInfo& b) { return a.fileSize > b.fileSize; });
+
+    uint64_t totalBytes = 0;
+    for (const auto& ssTable : ssTables)
+        totalBytes += ssTable.fileSize;
+
+    // every thread holds at most one run in memory, so all tasks together stay in the budget
+    const size_t runBudget = std::max(alBuildMemoryBudget / std::max(dbThreadPool->threadPool.getThreadCount(), static_cast<size_t>(1)), minAlBuildRunSize);
+
+    LOGGER_LOG_INFO("ALCreate: copying {} SSTables ({} bytes) into AL, run budget {} bytes", ssTables.size(), totalBytes, runBudget);
+
+    // tasks add entries to alFiles, the map is not touched by anybody else until tasks are done
+    std::mutex alFilesLock;
+    std::atomic<size_t> ssTablesDone{0};
+    std::atomic<uint64_t> bytesDone{0};
+
+    // AL file is a sorted run by secondary key
+    const auto writeRunF = [this, &alFilesLock](std::vector<DBRecord>& outRecords) -> void
+                           {
+                               std::sort(std::begin(outRecords), std::end(outRecords));
+
+                               size_t fileId;
+                               {
+                                   std::lock_guard<std::mutex> lock(alFilesLock);
+                                   fileId = newFileId++;
+                               }
+
+                               const std::string outFile = alFolderPath + hostPlatform::directorySeparator + std::to_string(fileId) + std::string(".alf");
+
+                               // write the records to the binary AL file, writer tracks min and max key for us
+                               DBAdaptiveLogFileWriter alFile(outFile);
+                               for (const auto& r : outRecords)
+                               {
+                                   LOGGER_LOG_TRACE("Writtitng key: ({}) and val:({})", r.getKey().ToString(), r.getVal().ToString());
+                                   alFile.append(r);
+                               }
+
+                               alFile.finish();
+
+                               // now we can create a SystemInfo for new AL file
+                               DBAdaptiveMergingIndex::DBAdaptiveLog::DBAdaptiveLogEntry alLog(fileId, outFile, alFile.getMinKey(), alFile.getMaxKey(), alFile.getNumRecords());
+                               alLog.bloomFilter = alFile.getFilter();
+
+                               {
+                                   std::lock_guard<std::mutex> lock(alFilesLock);
+                                   alFiles.emplace(fileId, std::move(alLog));
+                               }
+
+                               // clear() would keep the capacity and next runs would be charged for it,
+                               // fresh vector is reserved for the run as long as this one
+                               std::vector<DBRecord> nextRunRecords;
+                               nextRunRecords.reserve(outRecords.size());
+                               outRecords.swap(nextRunRecords);
+                           };
+
+    // read -> swap -> sort -> write, SSTable bigger than the run budget is written as several AL files
+    const auto singleSSTableCopyF = [&writeRunF, &skipRecord, runBudget, totalBytes, &ssTablesDone, &bytesDone, numSSTables = ssTables.size()](const DBSSTableInfo& ssTable) -> void
+                                    {
                                         // records are in format primKey, secKey|padding
                                         // we need secondaryIndex to swap records to secKey, primKey|padding
                                         std::vector<DBRecord> outRecords;
-                                        outRecords.reserve(ssTableRecords.size());
-                                        for (const auto& r : ssTableRecords)
+                                        size_t runDataBytes = 0;
+                                        DBDumper::forEachSSTableRecord(ssTable.filePath, [&outRecords, &runDataBytes, &writeRunF, &skipRecord, runBudget](const leveldb::Slice& key, const leveldb::Slice& val)
                                         {
-                                            DBRecord temp(r);
+                                            DBRecord temp(key, val);
                                             temp.swapPrimaryKeyWithSecondaryKey();
-                                            outRecords.push_back(temp);
-                                        }
+                                            if (skipRecord && skipRecord(temp.getKey()))
+                                                return;
 
-                                        // now we can create a SystemInfo for new AL file
-                                        DBRecord min = *std::min_element(std::begin(outRecords), std::end(outRecords));
-                                        DBRecord max = *std::max_element(std::begin(outRecords), std::end(outRecords));
-                                        std::string minKey = min.getKey().ToString();
-                                        std::string maxKey = max.getKey().ToString();
+                                            outRecords.push_back(std::move(temp));
 
-                                        this->alFiles[vecIndex] = DBAdaptiveMergingIndex::DBAdaptiveLog::DBAdaptiveLogEntry(outFile, minKey, maxKey, outRecords.size());
-
-                                        // write the records to the file in format: key value\nkey value\n....
-                                        std::ofstream alFile;
-                                        alFile.open(outFile);
+                                            // record buffers and the vector itself (with its spare capacity)
+                                            runDataBytes += key.size() + val.size();
+                                            if (runDataBytes + outRecords.capacity() * sizeof(DBRecord) >= runBudget)
+                                            {
+                                                writeRunF(outRecords);
+                                                runDataBytes = 0;
+                                            }
+                                        });
 
-                                        for (const auto& r : outRecords)
-                                        {
-                                            LOGGER_LOG_TRACE("Writtitng key: ({}) and val:({})", r.getKey().ToString(), r.getVal().ToString());
-                                            alFile << r.getKey().ToString() << " " << r.getVal().ToString() << std::endl;
-                                        }
+                                        if (!outRecords.empty())
+                                            writeRunF(outRecords);
 
-                                        alFile.close();
+                                        const size_t done = ssTablesDone.fetch_add(1) + 1;
+                                        const uint64_t bytes = bytesDone.fetch_add(ssTable.fileSize) + ssTable.fileSize;
+                                        LOGGER_LOG_INFO("ALCreate: {} / {} SSTables, {} / {} bytes ({}%)", done, numSSTables, bytes, totalBytes, totalBytes > 0 ? bytes * 100 / totalBytes : 100);
                                     };
 
-    // calculate how many files we have (we need to resize vector to get rid of the mutex in task)
-    size_t numFiles = 0;
-    for (const auto& levelVec : ssTables)
-        numFiles += levelVec.size();
-
-    alFiles.resize(numFiles);
+    DBTaskGroup tasks(dbThreadPool->threadPool);
 
-    std::vector<std::future<bool>> tasks;
-
-    // each thread will copy 1 ssTable
-    for (const auto& levelVec : ssTables)
-        for (const auto& file : levelVec)
-        {
-            LOGGER_LOG_TRACE("ALCreate: Submitting task for ssTable: {}", file);
-            const std::string outFileName = alFolderPath + hostPlatform::directorySeparator + std::to_string(newFileId) + std::string(".alf");
-            tasks.push_back(dbThreadPool->threadPool.submit(singleSSTableCopyF, file, outFileName, newFileId));
-            ++newFileId;
-        }
+    // each task will copy 1 ssTable
+    for (const auto& ssTable : ssTables)
+    {
+        LOGGER_LOG_TRACE("ALCreate: Submitting task for ssTable: {} (level {}, {} bytes)", ssTable.filePath, ssTable.level, ssTable.fileSize);
+        tasks.run([&singleSSTableCopyF, &ssTable]() { singleSSTableCopyF(ssTable); });
+    }
 
     // wait for tasks
-    for (const auto& t : tasks)
-        t.wait();
+    tasks.wait();
 
-    // copied all entries, sum them up
+    // copied all entries, sum them up and index their key ranges
     for (const auto& alF : alFiles)
-        alRecordsNumber += alF.numRecordsInFile;
+    {
+        alRecordsNumber += alF.second.numRecordsInFile;
+        alFilesIndex.insert(alF.first, alF.second.minKey, alF.second.maxKey);
+    }
 }
 
 void DBAdaptiveMergingIndex::DBAdaptiveLog::flushRamBuffer() noexcept(true)
@@ -101,10 +655,16 @@ void DBAdaptiveMergingIndex::DBAdaptiveLog::flushRamBuffer() noexcept(true)
     if (ramBuffer->getRecordsNumber() == 0)
     {
         LOGGER_LOG_DEBUG("Nothing to flush, ramBuiffer is empty");
+
+        // buffer can still hold nodes of deleted records
+        if (ramBuffer->getNodesNumber() > 0)
+            ramBuffer = std::make_unique<DBInMemoryIndex>();
+
         return;
     }
 
-    const std::string newAlFileName = alFolderPath + hostPlatform::directorySeparator + std::to_string(newFileId) + std::string(".alf");
+    const size_t fileId = newFileId;
+    const std::string newAlFileName = alFolderPath + hostPlatform::directorySeparator + std::to_string(fileId) + std::string(".alf");
     ++newFileId;
 
 
@@ -114,21 +674,21 @@ void DBAdaptiveMergingIndex::DBAdaptiveLog::flushRamBuffer() noexcept(true)
     std::vector<DBRecord> records = ramBuffer->getAllRecords();
 
     // write records from buffer to the new AL file
-    std::ofstream alFile;
-    alFile.open(newAlFileName);
-
+    DBAdaptiveLogFileWriter alFile(newAlFileName);
     for (const auto& r : records)
-        alFile << r.getKey().ToString() << " " << r.getVal().ToString() << std::endl;
+        alFile.append(r);
 
-    alFile.close();
+    alFile.finish();
 
     // create AL FileInfo
-    const DBAdaptiveMergingIndex::DBAdaptiveLog::DBAdaptiveLogEntry fileInfo(newAlFileName,
+    DBAdaptiveMergingIndex::DBAdaptiveLog::DBAdaptiveLogEntry fileInfo(fileId,
+                                                                             newAlFileName,
                                                                              records[0].getKey().ToString(),
                                                                              records[records.size() - 1].getKey().ToString(),
                                                                              records.size());
+    fileInfo.bloomFilter = alFile.getFilter();
 
-    alFiles.push_back(fileInfo);
+    addAlFile(fileInfo);
 
     // notice AL metadata as we inserted new values
     alRecordsNumber += records.size();
@@ -139,66 +699,91 @@ void DBAdaptiveMergingIndex::DBAdaptiveLog::flushRamBuffer() noexcept(true)
 
 void DBAdaptiveMergingIndex::DBAdaptiveLog::insertRecord(const DBRecord& r) noexcept(true)
 {
+    std::lock_guard<std::shared_mutex> lock(alMutex);
+
+    ownRecords = true;
     ramBuffer->insertRecord(r);
-    if (ramBuffer->getRecordsNumber() >= ramBufferCapacity)
-            flushRamBuffer();
+    // deleted records still take nodes, so they count to the capacity
+    // flushed records are only in AL, so the manifest has to reference the new file
+    if (ramBuffer->getNodesNumber() >= ramBufferCapacity)
+    {
+        flushRamBuffer();
+        checkpointNeeded = true;
+    }
 }
 
 void DBAdaptiveMergingIndex::DBAdaptiveLog::deleteRecord(const std::string& key) noexcept(true)
 {
-    ramBuffer->deleteRecord(key);
+    std::vector<size_t> fileIds;
 
-    const std::vector<std::reference_wrapper<DBAdaptiveMergingIndex::DBAdaptiveLog::DBAdaptiveLogEntry>> alLogVec = getALLogEntriesForRange(key, key);
+    // primaryIndex still has the record, AL rebuilt from it would bring the record back
+    ownRecords = true;
 
-    const auto deleteInAlFileF =    [](const std::reference_wrapper<DBAdaptiveMergingIndex::DBAdaptiveLog::DBAdaptiveLogEntry>& alLog, const std::string& dKey) -> void
-                                    {
-                                        std::ifstream alFile;
-                                        alFile.open(alLog.get().filePath);
+    {
+        std::shared_lock<std::shared_mutex> lock(alMutex);
+
+        ramBuffer->deleteRecord(key);
+        mergeBuffer->deleteRecord(key);
+
+        const std::vector<std::reference_wrapper<DBAdaptiveMergingIndex::DBAdaptiveLog::DBAdaptiveLogEntry>> alLogVec = getALLogEntriesForRange(key, key);
 
-                                        std::vector<std::string> validKeys;
-                                        LOGGER_LOG_TRACE("alLog {}: <{},{}> {}", alLog.get().filePath, alLog.get().minKey, alLog.get().maxKey, alLog.get().numRecordsInFile);
-                                        for (size_t i = 0; i < alLog.get().numRecordsInFile; ++i)
+        const auto deleteInAlFileF =    [this](const std::reference_wrapper<DBAdaptiveMergingIndex::DBAdaptiveLog::DBAdaptiveLogEntry>& alLog, const std::string& dKey) -> size_t
                                         {
-                                            std::string rKey;
-                                            std::string rVal;
-                                            alFile >> rKey >> rVal;
-                                            LOGGER_LOG_TRACE("Get Key:({}) and VAL:({}), want to delete ({}), touched[{}]={}", rKey, rVal, dKey, i, alLog.get().touchedEntries[i]);
-                                            if (alLog.get().touchedEntries[i] == 0)
+                                            std::lock_guard<std::mutex> entryLock(*alLog.get().entryMutex);
+                                            if (alLog.get().shouldBeDeleted)
+                                                return 0;
+
+                                            const DBAdaptiveLogFileReader alFile(alLog.get().filePath);
+
+                                            const leveldb::Slice dKeySlice(dKey);
+                                            size_t deletedRecords = 0;
+
+                                            LOGGER_LOG_TRACE("alLog {}: <{},{}> {}", alLog.get().filePath, alLog.get().minKey, alLog.get().maxKey, alLog.get().numRecordsInFile);
+                                            alFile.forEachRecordInRange(dKeySlice, dKeySlice, [&alLog, &dKey, &deletedRecords](size_t i, const leveldb::Slice& rKey, const leveldb::Slice& rVal)
                                             {
+                                                LOGGER_LOG_TRACE("Get Key:({}) and VAL:({}), want to delete ({}), touched[{}]={}", rKey.ToString(), rVal.ToString(), dKey, i, alLog.get().touchedEntries[i]);
+
                                                 // delete -> mark as touched
-                                                if (rKey == dKey)
+                                                if (alLog.get().touchedEntries[i] == 0)
                                                 {
                                                     LOGGER_LOG_TRACE("Deleting {} on pos {}", dKey, i);
                                                     alLog.get().touchedEntries[i] = 1;
+                                                    ++alLog.get().numTouchedEntries;
+                                                    ++deletedRecords;
                                                 }
-                                                else
-                                                    validKeys.push_back(rKey);
-                                            }
-                                        }
+                                            });
 
-                                        // update alLog
-                                        if (validKeys.size() == 0)
-                                            alLog.get().shouldBeDeleted = true;
-                                        else
-                                        {
-                                            alLog.get().minKey = *std::min_element(std::begin(validKeys), std::end(validKeys));
-                                            alLog.get().maxKey = *std::max_element(std::begin(validKeys), std::end(validKeys));
-                                        }
+                                            // update alLog
+                                            updateAlLogEntryKeyRange(alLog.get(), alFile);
+                                            rewriteAlFile(alLog.get(), alFile);
 
-                                        alFile.close();
-                                    };
+                                            return deletedRecords;
+                                        };
 
+        // each thread will check and delete 1 alFile
+        std::vector<size_t> deletedRecords(alLogVec.size(), 0);
+        DBTaskGroup tasks(dbThreadPool->threadPool);
 
+        for (size_t i = 0; i < alLogVec.size(); ++i)
+        {
+            fileIds.push_back(alLogVec[i].get().fileId);
+            tasks.run([&deleteInAlFileF, &alLogVec, &deletedRecords, &key, i]() { deletedRecords[i] = deleteInAlFileF(alLogVec[i], key); });
+        }
 
-    // each thread will check and delete 1 alFile
-    std::vector<std::future<bool>> tasks;
+        // wait for tasks
+        tasks.wait();
+        for (const size_t d : deletedRecords)
+            alRecordsNumber -= d;
+    }
 
-    for (const auto& alLog : alLogVec)
-        tasks.push_back(dbThreadPool->threadPool.submit(deleteInAlFileF, alLog, key));
+    // lookups which did not change any range do not wait for concurrent scans
+    if (fileIds.empty())
+        return;
 
-    // wait for tasks
-    for (const auto& t : tasks)
-        t.wait();
+    // key ranges changed, so index and file list need exclusive lock
+    std::lock_guard<std::shared_mutex> lock(alMutex);
+    updateAlFilesIndex(fileIds);
+    removeDeletedAlFiles();
 }
 
 std::vector<DBRecord> DBAdaptiveMergingIndex::DBAdaptiveLog::psearch(const std::string& key) noexcept(true)
@@ -207,119 +792,195 @@ std::vector<DBRecord> DBAdaptiveMergingIndex::DBAdaptiveLog::psearch(const std::
 }
 
 std::vector<DBRecord> DBAdaptiveMergingIndex::DBAdaptiveLog::rsearch(const std::string& minKey, const std::string& maxKey) noexcept(true)
+{
+    DBRecordSet ret;
+    rsearchInto(minKey, maxKey, ret);
+
+    return ret.toVector();
+}
+
+void DBAdaptiveMergingIndex::DBAdaptiveLog::rsearchInto(const std::string& minKey, const std::string& maxKey, DBRecordSet& out) noexcept(true)
 {
     if (minKey > maxKey)
-        return std::vector<DBRecord>();
+        return;
 
-    std::vector<DBRecord> ret = ramBuffer->rsearch(minKey, maxKey);
+    std::vector<size_t> fileIds;
 
-    const std::vector<std::reference_wrapper<DBAdaptiveMergingIndex::DBAdaptiveLog::DBAdaptiveLogEntry>> alLogVec = getALLogEntriesForRange(minKey, maxKey);
+    {
+        std::shared_lock<std::shared_mutex> lock(alMutex);
 
-    const auto rsearchInAlFileF =   [](const std::reference_wrapper<DBAdaptiveMergingIndex::DBAdaptiveLog::DBAdaptiveLogEntry>& alLog, const std::string& sMinKey, const std::string& sMaxKey) -> std::vector<DBRecord>
-                                    {
-                                        std::ifstream alFile;
-                                        alFile.open(alLog.get().filePath);
+        // records are moved from ramBuffer and AL files into mergeBuffer, always inserted there before removal from the source
+        // so a concurrent search looking at the source first and mergeBuffer later can not miss them
+        for (const auto& r : ramBuffer->rsearch(minKey, maxKey))
+        {
+            mergeBuffer->insertRecord(r);
+            ramBuffer->deleteRecord(r.getKey().ToString());
+        }
 
-                                        std::vector<std::string> validKeys;
-                                        std::vector<DBRecord> queryRet;
+        const std::vector<std::reference_wrapper<DBAdaptiveMergingIndex::DBAdaptiveLog::DBAdaptiveLogEntry>> alLogVec = getALLogEntriesForRange(minKey, maxKey);
 
-                                        LOGGER_LOG_TRACE("alLog {}: <{},{}> {}", alLog.get().filePath, alLog.get().minKey, alLog.get().maxKey, alLog.get().numRecordsInFile);
-                                        for (size_t i = 0; i < alLog.get().numRecordsInFile; ++i)
+        // rangeChanged is set when file key range or shouldBeDeleted changed, only then index needs the exclusive lock
+        const auto rsearchInAlFileF =   [this](const std::reference_wrapper<DBAdaptiveMergingIndex::DBAdaptiveLog::DBAdaptiveLogEntry>& alLog, const std::string& sMinKey, const std::string& sMaxKey, uint8_t& rangeChanged) -> size_t
                                         {
-                                            std::string rKey;
-                                            std::string rVal;
-                                            alFile >> rKey >> rVal;
-                                            LOGGER_LOG_TRACE("Get Key:({}) and VAL:({}), looking for ({}, {}), touched[{}]={}", rKey, rVal, sMinKey, sMaxKey, i, alLog.get().touchedEntries[i]);
+                                            std::lock_guard<std::mutex> entryLock(*alLog.get().entryMutex);
+                                            if (alLog.get().shouldBeDeleted)
+                                                return 0;
 
-                                            if (alLog.get().touchedEntries[i] == 0 && rKey >= sMinKey && rKey <= sMaxKey)
-                                            {
-                                                queryRet.push_back(DBRecord(rKey, rVal));
-                                                alLog.get().touchedEntries[i] = 1; // just now we touched this to return in search query
-                                            }
+                                            const DBAdaptiveLogFileReader alFile(alLog.get().filePath);
+                                            const leveldb::Slice minSlice(sMinKey);
+                                            const leveldb::Slice maxSlice(sMaxKey);
 
-                                            if (alLog.get().touchedEntries[i] == 0) // still valid
-                                                validKeys.push_back(rKey);
-                                        }
+                                            size_t movedRecords = 0;
 
-                                        // update alLog
-                                        if (validKeys.size() == 0)
-                                            alLog.get().shouldBeDeleted = true;
-                                        else
-                                        {
-                                            alLog.get().minKey = *std::min_element(std::begin(validKeys), std::end(validKeys));
-                                            alLog.get().maxKey = *std::max_element(std::begin(validKeys), std::end(validKeys));
-                                        }
+                                            LOGGER_LOG_TRACE("alLog {}: <{},{}> {}", alLog.get().filePath, alLog.get().minKey, alLog.get().maxKey, alLog.get().numRecordsInFile);
+                                            alFile.forEachRecordInRange(minSlice, maxSlice, [&](size_t i, const leveldb::Slice& rKey, const leveldb::Slice& rVal)
+                                            {
+                                                LOGGER_LOG_TRACE("Get Key:({}) and VAL:({}), looking for ({}, {}), touched[{}]={}", rKey.ToString(), rVal.ToString(), sMinKey, sMaxKey, i, alLog.get().touchedEntries[i]);
 
-                                        alFile.close();
+                                                if (alLog.get().touchedEntries[i] == 0)
+                                                {
+                                                    mergeBuffer->insertRecord(DBRecord(rKey, rVal));
+                                                    alLog.get().touchedEntries[i] = 1; // just now we touched this to return in search query
+                                                    ++alLog.get().numTouchedEntries;
+                                                    ++movedRecords;
+                                                }
+                                            });
 
-                                        return queryRet;
-                                    };
+                                            // nothing touched, range and file stay the same
+                                            if (movedRecords == 0)
+                                                return 0;
 
+                                            // update alLog
+                                            const std::string oldMinKey = alLog.get().minKey;
+                                            const std::string oldMaxKey = alLog.get().maxKey;
+                                            updateAlLogEntryKeyRange(alLog.get(), alFile);
+                                            rewriteAlFile(alLog.get(), alFile);
 
+                                            rangeChanged = alLog.get().shouldBeDeleted || alLog.get().minKey != oldMinKey || alLog.get().maxKey != oldMaxKey;
 
-    // each thread scan 1 alFile
-    std::vector<std::future<std::vector<DBRecord>>> tasks;
-    for (const auto& alFile : alLogVec)
-        if (!alFile.get().shouldBeDeleted)
-            tasks.push_back(dbThreadPool->threadPool.submit(rsearchInAlFileF, alFile, minKey, maxKey));
+                                            return movedRecords;
+                                        };
 
-    std::vector<std::vector<DBRecord>> recordsFromTasks;
+        // each thread scan 1 alFile
+        std::vector<size_t> movedRecords(alLogVec.size(), 0);
+        std::vector<uint8_t> rangeChanged(alLogVec.size(), 0);
+        DBTaskGroup tasks(dbThreadPool->threadPool);
+        for (size_t i = 0; i < alLogVec.size(); ++i)
+            tasks.run([&rsearchInAlFileF, &alLogVec, &movedRecords, &rangeChanged, &minKey, &maxKey, i]() { movedRecords[i] = rsearchInAlFileF(alLogVec[i], minKey, maxKey, rangeChanged[i]); });
 
-    // wait for tasks
-    for (auto& t : tasks)
-        recordsFromTasks.push_back(t.get());
+        // wait for tasks, moved records are not in AL files anymore
+        tasks.wait();
+        for (size_t i = 0; i < alLogVec.size(); ++i)
+        {
+            alRecordsNumber -= movedRecords[i];
+            if (rangeChanged[i] != 0)
+                fileIds.push_back(alLogVec[i].get().fileId);
+        }
 
-    // aggregate records from alFiles into 1 big vector ret
-    for (const auto& vec : recordsFromTasks)
-        ret.insert(std::end(ret), std::begin(vec), std::end(vec));
+        // mergeBuffer has our records and records moved by concurrent searches
+        mergeBuffer->rsearchInto(minKey, maxKey, out);
+    }
 
-    return ret;
+    // lookups which did not change any range do not wait for concurrent scans
+    if (fileIds.empty())
+        return;
+
+    // key ranges changed, so index and file list need exclusive lock
+    std::lock_guard<std::shared_mutex> lock(alMutex);
+    updateAlFilesIndex(fileIds);
+    removeDeletedAlFiles();
 }
 
 std::vector<DBRecord> DBAdaptiveMergingIndex::DBAdaptiveLog::getAllRecords() noexcept(true)
 {
-    std::vector<DBRecord> ret = ramBuffer->getAllRecords();
+    DBRecordSet ret;
+    getAllRecordsInto(ret);
 
-    const auto scanAlFileF =    [](const DBAdaptiveMergingIndex::DBAdaptiveLog::DBAdaptiveLogEntry& alLog) -> std::vector<DBRecord>
+    return ret.toVector();
+}
+
+void DBAdaptiveMergingIndex::DBAdaptiveLog::getAllRecordsInto(DBRecordSet& out) noexcept(true)
+{
+    std::shared_lock<std::shared_mutex> lock(alMutex);
+
+    ramBuffer->getAllRecordsInto(out);
+
+    const auto scanAlFileF =    [](const std::reference_wrapper<DBAdaptiveMergingIndex::DBAdaptiveLog::DBAdaptiveLogEntry>& alLog) -> DBRecordSet
                                 {
-                                    std::ifstream alFile;
-                                    alFile.open(alLog.filePath);
+                                    std::lock_guard<std::mutex> entryLock(*alLog.get().entryMutex);
 
-                                    std::vector<DBRecord> alLogRecords;
+                                    DBRecordSet alLogRecords;
+                                    if (alLog.get().shouldBeDeleted)
+                                        return alLogRecords;
 
-                                    for (size_t i = 0; i < alLog.numRecordsInFile; ++i)
-                                    {
-                                        std::string rKey;
-                                        std::string rVal;
-                                        alFile >> rKey >> rVal;
-                                        if (alLog.touchedEntries[i] == 0)
-                                            alLogRecords.push_back(DBRecord(rKey, rVal));
-                                    }
+                                    const DBAdaptiveLogFileReader alFile(alLog.get().filePath);
 
-                                    alFile.close();
+                                    alFile.forEachRecord([&alLog, &alLogRecords](size_t i, const leveldb::Slice& rKey, const leveldb::Slice& rVal)
+                                    {
+                                        if (alLog.get().touchedEntries[i] == 0)
+                                            alLogRecords.append(rKey, rVal);
+                                    });
 
                                     return alLogRecords;
                                 };
 
-    // each thread scan 1 alFile
-    std::vector<std::future<std::vector<DBRecord>>> tasks;
-    for (const auto& alFile : alFiles)
-        if (!alFile.shouldBeDeleted)
-            tasks.push_back(dbThreadPool->threadPool.submit(scanAlFileF, alFile));
+    // each thread scan 1 alFile into own set
+    std::vector<DBRecordSet> alFilesRecords(alFiles.size());
+    DBTaskGroup tasks(dbThreadPool->threadPool);
+    size_t alFileIndex = 0;
+    for (auto& alFile : alFiles)
+    {
+        tasks.run([&scanAlFileF, &alFilesRecords, &alFile, alFileIndex]() { alFilesRecords[alFileIndex] = scanAlFileF(std::ref(alFile.second)); });
+        ++alFileIndex;
+    }
 
-    std::vector<std::vector<DBRecord>> recordsFromTasks;
+    // wait for tasks and splice their sets, records are not copied again
+    tasks.wait();
+    for (auto& alFileRecords : alFilesRecords)
+        out.splice(std::move(alFileRecords));
 
-    // wait for tasks
-    for (auto& t : tasks)
-        recordsFromTasks.push_back(t.get());
+    // records waiting for merge are still part of AL
+    mergeBuffer->getAllRecordsInto(out);
+}
 
-    // aggregate records from alFiles into 1 big vector ret
-    for (const auto& vec : recordsFromTasks)
-        ret.insert(std::end(ret), std::begin(vec), std::end(vec));
+std::unique_ptr<DBIndexCursor> DBAdaptiveMergingIndex::DBAdaptiveLog::newCursor() noexcept(true)
+{
+    // exclusive lock, so no search moves records between buffers and files while we take the snapshot
+    std::lock_guard<std::shared_mutex> lock(alMutex);
 
-    return ret;
+    // buffer cursors are live, but searches move records from ramBuffer to mergeBuffer after we release the lock
+    // and a live cursor could miss them, so buffers are copied
+    DBRecordSet ramRecords;
+    ramBuffer->getAllRecordsInto(ramRecords);
+
+    DBRecordSet mergeRecords;
+    mergeBuffer->getAllRecordsInto(mergeRecords);
+
+    std::vector<std::unique_ptr<DBIndexCursor>> cursors;
+    cursors.push_back(std::make_unique<DBRecordSetCursor>(std::move(ramRecords)));
+    cursors.push_back(std::make_unique<DBRecordSetCursor>(std::move(mergeRecords)));
+
+    for (const auto& alFile : alFiles)
+    {
+        if (alFile.second.shouldBeDeleted)
+            continue;
+
+        const std::shared_ptr<const DBAdaptiveLogFileReader> reader = std::make_shared<const DBAdaptiveLogFileReader>(alFile.second.filePath);
+        cursors.push_back(std::make_unique<DBAdaptiveLogFileCursor>(reader, alFile.second.touchedEntries));
+    }
+
+    return std::make_unique<DBMergingCursor>(std::move(cursors));
 }
 
+std::vector<DBRecord> DBAdaptiveMergingIndex::DBAdaptiveLog::takeMergeBuffer() noexcept(true)
+{
+    std::lock_guard<std::shared_mutex> lock(alMutex);
+
+    std::vector<DBRecord> records = mergeBuffer->getAllRecords();
+    mergeBuffer = std::make_unique<DBInMemoryIndex>();
+
+    return records;
+}
 
 void DBAdaptiveMergingIndex::do_insertRecord(const DBRecord& r) noexcept(true)
 {
@@ -331,20 +992,21 @@ void DBAdaptiveMergingIndex::do_deleteRecord(const std::string& key) noexcept(tr
 {
     // records can be in AL or secIndex so delete from both of them
     // this deletion can be do in 2 threads.
-    // main thread will delete from AL, second thread (future) will delete from secondaryIndex
+    // main thread will delete from AL, pool task will delete from secondaryIndex
 
     // run deletion on sec Index in background
     const auto delF =   [this] (const std::string& sKey) -> void
                         {
                             secondaryIndex->deleteRecord(sKey);
                         };
-    std::future<bool> secIndexDeleteTask = dbThreadPool->threadPool.submit(delF, key);
+    DBTaskGroup secIndexTask(dbThreadPool->threadPool);
+    secIndexTask.run([&delF, &key]() { delF(key); });
 
     // delete from AL
     adaptiveLog->deleteRecord(key);
 
-    // wait for background task
-    secIndexDeleteTask.wait();
+    // wait for background task, run it here if no worker has started it
+    secIndexTask.wait();
 }
 
 std::vector<DBRecord> DBAdaptiveMergingIndex::do_psearch(const std::string& key) noexcept(true)
@@ -353,109 +1015,302 @@ std::vector<DBRecord> DBAdaptiveMergingIndex::do_psearch(const std::string& key)
 
     // record can be in secIndex or in AL
     // main thread will check AL
-    // background thread(future) will check secIndex
+    // pool task will check secIndex
+    // merge is blocked by our lock, so record can not move from AL into secIndex during the search
 
     const auto psearchF =   [this] (const std::string& sKey) -> std::vector<DBRecord>
                             {
                                 return secondaryIndex->psearch(sKey);
                             };
-    std::future<std::vector<DBRecord>> secIndexPSearchTask = dbThreadPool->threadPool.submit(psearchF, key);
+    std::vector<DBRecord> retSecIndex;
+    DBTaskGroup secIndexTask(dbThreadPool->threadPool);
+    secIndexTask.run([&psearchF, &retSecIndex, &key]() { retSecIndex = psearchF(key); });
 
-    const std::vector<DBRecord> retAL = adaptiveLog->psearch(key);
-    const std::vector<DBRecord> retSecIndex = secIndexPSearchTask.get();
+    std::vector<DBRecord> retAL = adaptiveLog->psearch(key);
+    secIndexTask.wait();
 
-    // copy retAL and retSecIndex to ret
-    ret.insert(std::end(ret), std::begin(retAL), std::end(retAL));
-    ret.insert(std::end(ret), std::begin(retSecIndex), std::end(retSecIndex));
-
-    // ret is ready, time to add touched entries from AL to secIndex
-    for (const auto& r : retAL)
-        secondaryIndex->insertRecord(r);
+    // move retAL and retSecIndex to ret
+    ret = std::move(retAL);
+    ret.insert(std::end(ret), std::make_move_iterator(std::begin(retSecIndex)), std::make_move_iterator(std::end(retSecIndex)));
 
     return ret;
 }
 
-std::vector<DBRecord> DBAdaptiveMergingIndex::do_rsearch(const std::string& minKey, const std::string& maxKey) noexcept(true)
+void DBAdaptiveMergingIndex::do_rsearchInto(const std::string& minKey, const std::string& maxKey, DBRecordSet& out) noexcept(true)
 {
     if (maxKey < minKey)
-        return std::vector<DBRecord>();
-
-    std::vector<DBRecord> ret;
+        return;
 
     // records can be in secIndex and in AL
     // main thread will check AL
-    // background thread(future) will check secIndex
+    // pool task will check secIndex
+    // merge is blocked by our lock, so records can not move from AL into secIndex during the search
 
-    const auto rsearchF =   [this] (const std::string& sMinKey, const std::string& sMaxKey) -> std::vector<DBRecord>
+    const auto rsearchF =   [this] (const std::string& sMinKey, const std::string& sMaxKey) -> DBRecordSet
                             {
-                                return secondaryIndex->rsearch(sMinKey, sMaxKey);
-                            };
-    std::future<std::vector<DBRecord>> secIndexRSearchTask = dbThreadPool->threadPool.submit(rsearchF, minKey, maxKey);
+                                DBRecordSet secIndexRecords;
+                                secondaryIndex->rsearchInto(sMinKey, sMaxKey, secIndexRecords);
 
-    const std::vector<DBRecord> retAL = adaptiveLog->rsearch(minKey, maxKey);
-    const std::vector<DBRecord> retSecIndex = secIndexRSearchTask.get();
-
-    // copy retAL and retSecIndex to ret
-    ret.insert(std::end(ret), std::begin(retAL), std::end(retAL));
-    ret.insert(std::end(ret), std::begin(retSecIndex), std::end(retSecIndex));
-
-    // ret is ready, time to add touched entries from AL to secIndex
-    for (const auto& r : retAL)
-        secondaryIndex->insertRecord(r);
+                                return secIndexRecords;
+                            };
+    DBRecordSet secIndexRecords;
+    DBTaskGroup secIndexTask(dbThreadPool->threadPool);
+    secIndexTask.run([&rsearchF, &secIndexRecords, &minKey, &maxKey]() { secIndexRecords = rsearchF(minKey, maxKey); });
 
-    return ret;
+    adaptiveLog->rsearchInto(minKey, maxKey, out);
+    secIndexTask.wait();
+    out.splice(std::move(secIndexRecords));
 }
 
-std::vector<DBRecord> DBAdaptiveMergingIndex::do_getAllRecords() noexcept(true)
+void DBAdaptiveMergingIndex::do_getAllRecordsInto(DBRecordSet& out) noexcept(true)
 {
-    std::vector<DBRecord> ret;
-
     // records can be in secIndex and in AL
     // main thread will get entries from AL
-    // background thread(future) will get entries from secIndex
+    // pool task will get entries from secIndex
 
-    const auto getAllRecordsF = [this] () -> std::vector<DBRecord>
+    const auto getAllRecordsF = [this] () -> DBRecordSet
                                 {
-                                    return secondaryIndex->getAllRecords();
+                                    DBRecordSet secIndexRecords;
+                                    secondaryIndex->getAllRecordsInto(secIndexRecords);
+
+                                    return secIndexRecords;
                                 };
-    std::future<std::vector<DBRecord>> secIndexGetAllRecordsTask = dbThreadPool->threadPool.submit(getAllRecordsF);
+    DBRecordSet secIndexRecords;
+    DBTaskGroup secIndexTask(dbThreadPool->threadPool);
+    secIndexTask.run([&getAllRecordsF, &secIndexRecords]() { secIndexRecords = getAllRecordsF(); });
 
-    const std::vector<DBRecord> retAL = adaptiveLog->getAllRecords();
-    const std::vector<DBRecord> retSecIndex = secIndexGetAllRecordsTask.get();
+    adaptiveLog->getAllRecordsInto(out);
+    secIndexTask.wait();
+    out.splice(std::move(secIndexRecords));
+}
 
-    // copy retAL and retSecIndex to ret
-    ret.insert(std::end(ret), std::begin(retAL), std::end(retAL));
-    ret.insert(std::end(ret), std::begin(retSecIndex), std::end(retSecIndex));
+std::unique_ptr<DBIndexCursor> DBAdaptiveMergingIndex::do_newCursor() noexcept(true)
+{
+    // merge is blocked by our lock, so AL and secIndex snapshots see each record once
+    std::vector<std::unique_ptr<DBIndexCursor>> cursors;
+    cursors.push_back(adaptiveLog->newCursor());
+    cursors.push_back(secondaryIndex->newCursor());
 
-    return ret;
+    return std::make_unique<DBMergingCursor>(std::move(cursors));
+}
+
+void DBAdaptiveMergingIndex::do_mergeAdaptiveLog() noexcept(true)
+{
+    // records touched by searches are ready, time to add them to secIndex
+    const std::vector<DBRecord> records = adaptiveLog->takeMergeBuffer();
+    if (records.empty())
+        return;
+
+    LOGGER_LOG_DEBUG("Merging {} records from AL into secondaryIndex", records.size());
+
+    // mergeBuffer is sorted, so whole run goes to the secIndex as one batch
+    secondaryIndex->insertRecords(records);
+}
+
+void DBAdaptiveMergingIndex::mergeAdaptiveLog() noexcept(true)
+{
+    std::lock_guard<std::shared_mutex> lock(mergeMutex);
+    do_mergeAdaptiveLog();
+}
+
+void DBAdaptiveMergingIndex::scheduleMergeAdaptiveLog() noexcept(true)
+{
+    // searches served without touching AL files must not wait for the exclusive lock
+    const size_t pendingRecords = adaptiveLog->getMergeBufferRecordsNumber();
+    if (pendingRecords == 0)
+        return;
+
+    if (!asyncMerge || pendingRecords >= maxPendingMergeRecords)
+    {
+        mergeAdaptiveLog();
+        return;
+    }
+
+    // one background merge at a time is enough, it takes whole mergeBuffer
+    if (mergeScheduled.exchange(true))
+        return;
+
+    const auto mergeF = [this] () -> void
+                        {
+                            // searches hold the lock in shared mode, so merge backs off and tries again instead of being dropped
+                            // waiting on the pool worker is safe: searches join their pool tasks by DBTaskGroup, which runs not started tasks in the caller
+                            std::unique_lock<std::shared_mutex> lock(mergeMutex, std::try_to_lock);
+                            std::chrono::microseconds backoff = mergeLockFirstBackoff;
+                            for (size_t retry = 0; retry < mergeLockRetries && !lock.owns_lock(); ++retry)
+                            {
+                                LOGGER_LOG_TRACE("Background merge postponed for {} us, index is busy", backoff.count());
+                                std::this_thread::sleep_for(backoff);
+                                backoff *= 2;
+                                lock.try_lock();
+                            }
+
+                            if (!lock.owns_lock())
+                                lock.lock();
+
+                            // records added from now on need a new merge
+                            mergeScheduled = false;
+
+                            do_mergeAdaptiveLog();
+                        };
+
+    std::lock_guard<std::mutex> tasksLock(mergeTasksMutex);
+
+    // forget finished merges
+    mergeTasks.erase(std::remove_if(std::begin(mergeTasks), std::end(mergeTasks),
+                                    [](const std::future<bool>& t) { return t.wait_for(std::chrono::seconds(0)) == std::future_status::ready; }),
+                     std::end(mergeTasks));
+
+    mergeTasks.push_back(dbThreadPool->threadPool.submit(mergeF));
+}
+
+void DBAdaptiveMergingIndex::openAdaptiveLog(const size_t secIndexBufferCapacity, const DBLevelDbOptions& secIndexOptions) noexcept(true)
+{
+    const auto countSecIndexRecordsF =  [this] () -> size_t
+                                        {
+                                            size_t records = 0;
+                                            secondaryIndex->forEachRecord([&records](const leveldb::Slice&, const leveldb::Slice&) { ++records; return true; });
+
+                                            return records;
+                                        };
+
+    if (adaptiveLog->isRestoredFromManifest())
+    {
+        const bool primaryIndexMatches = adaptiveLog->matchesPrimaryIndex();
+        if (primaryIndexMatches || adaptiveLog->hasOwnRecords())
+        {
+            // inserted and deleted records exist only in AL and secIndex, they cannot be rebuilt from primaryIndex
+            if (!primaryIndexMatches)
+            {
+                LOGGER_LOG_ERROR("PrimaryIndex {} changed since AL was copied from it, AL has own records so it is kept, changes of primaryIndex are not visible", primaryIndex->getIndexFolder());
+                std::cerr << "PrimaryIndex " << primaryIndex->getIndexFolder() << " does not match AL manifest, AL with own records is kept and primaryIndex changes are not visible" << std::endl;
+            }
+
+            if (adaptiveLog->isRestoredAfterCrash())
+            {
+                // number of secIndex records was not saved, records merged after the manifest are in both indexes
+                LOGGER_LOG_WARN("AL of {} was not closed, recovering from the last manifest", primaryIndex->getIndexFolder());
+                secondaryIndex->restoreRecordsNumber(countSecIndexRecordsF());
+                adaptiveLog->removeRecordsFoundIn(*secondaryIndex);
+            }
+            else
+                secondaryIndex->restoreRecordsNumber(adaptiveLog->getRestoredSecIndexRecordsNumber());
+
+            // manifest says AL was closed, from now on it is in use
+            do_persist(false);
+            return;
+        }
+
+        // AL and secIndex hold only an old copy of primaryIndex records, so both can be rebuilt
+        LOGGER_LOG_INFO("PrimaryIndex {} changed since AL was copied from it, rebuilding AL and secondaryIndex", primaryIndex->getIndexFolder());
+        const std::string secIndexFolder = secondaryIndex->getIndexFolder();
+        secondaryIndex.reset();
+        leveldb::DestroyDB(secIndexFolder, leveldb::Options());
+        secondaryIndex = std::make_unique<DBLevelDbIndex>(secIndexFolder, secIndexBufferCapacity, secIndexOptions);
+        adaptiveLog->rebuild(nullptr);
+        return;
+    }
+
+    // no manifest: first open or AL copy did not finish, secIndex can not have records merged from this AL
+    if (!secondaryIndex->newCursor()->isValid())
+    {
+        adaptiveLog->rebuild(nullptr);
+        return;
+    }
+
+    // manifest lost while secIndex has records, keep them and copy into AL only primaryIndex records not merged yet
+    // old AL files can hold inserted records, they are moved aside instead of being removed
+    const std::string alFolder = adaptiveLog->getIndexFolder();
+    std::string lostFolder = alFolder + std::string("_lost");
+    for (size_t i = 1; std::filesystem::exists(lostFolder); ++i)
+        lostFolder = alFolder + std::string("_lost") + std::to_string(i);
+
+    std::error_code ec;
+    std::filesystem::rename(alFolder, lostFolder, ec);
+    std::filesystem::create_directories(alFolder, ec);
+
+    LOGGER_LOG_ERROR("AL manifest of {} is missing or corrupted, secondaryIndex is kept, AL is copied from primaryIndex without its records, old AL files moved to {}", primaryIndex->getIndexFolder(), lostFolder);
+    std::cerr << "AL manifest of " << primaryIndex->getIndexFolder() << " is missing or corrupted, old AL files moved to " << lostFolder << ", records inserted into AL and deleted records can be lost" << std::endl;
+
+    secondaryIndex->restoreRecordsNumber(countSecIndexRecordsF());
+    adaptiveLog->rebuild([this](const leveldb::Slice& key) { return secondaryIndex->psearch(key.ToString()).size() > 0; });
+}
+
+void DBAdaptiveMergingIndex::do_persist(const bool closed) noexcept(true)
+{
+    do_mergeAdaptiveLog();
+    secondaryIndex->flushInMemoryIndex();
+    adaptiveLog->persist(secondaryIndex->getRecordsNumber(), closed);
 }
 
 void DBAdaptiveMergingIndex::insertRecord(const DBRecord& r) noexcept(true)
 {
-    std::lock_guard<std::mutex> lock(dbMutex);
-    do_insertRecord(r);
+    {
+        std::shared_lock<std::shared_mutex> lock(mergeMutex);
+        do_insertRecord(r);
+    }
+
+    // new AL file holds records which are nowhere else, so the manifest has to reference it (another insert could do it already)
+    if (adaptiveLog->isCheckpointNeeded())
+    {
+        std::lock_guard<std::shared_mutex> lock(mergeMutex);
+        if (adaptiveLog->isCheckpointNeeded())
+            do_persist(false);
+    }
 }
 
 void DBAdaptiveMergingIndex::deleteRecord(const std::string& key) noexcept(true)
 {
-    std::lock_guard<std::mutex> lock(dbMutex);
+    std::lock_guard<std::shared_mutex> lock(mergeMutex);
     do_deleteRecord(key);
 }
 
 std::vector<DBRecord> DBAdaptiveMergingIndex::psearch(const std::string& key) noexcept(true)
 {
-    std::lock_guard<std::mutex> lock(dbMutex);
-    return do_psearch(key);
+    std::vector<DBRecord> ret;
+    {
+        std::shared_lock<std::shared_mutex> lock(mergeMutex);
+        ret = do_psearch(key);
+    }
+
+    scheduleMergeAdaptiveLog();
+
+    return ret;
 }
 
 std::vector<DBRecord> DBAdaptiveMergingIndex::rsearch(const std::string& minKey, const std::string& maxKey) noexcept(true)
 {
-    std::lock_guard<std::mutex> lock(dbMutex);
-    return do_rsearch(minKey, maxKey);
+    DBRecordSet ret;
+    rsearchInto(minKey, maxKey, ret);
+
+    return ret.toVector();
 }
 
 std::vector<DBRecord> DBAdaptiveMergingIndex::getAllRecords() noexcept(true)
 {
-    std::lock_guard<std::mutex> lock(dbMutex);
-    return do_getAllRecords();
-}
\ No newline at end of file
+    DBRecordSet ret;
+    getAllRecordsInto(ret);
+
+    return ret.toVector();
+}
+
+void DBAdaptiveMergingIndex::rsearchInto(const std::string& minKey, const std::string& maxKey, DBRecordSet& out) noexcept(true)
+{
+    {
+        std::shared_lock<std::shared_mutex> lock(mergeMutex);
+        do_rsearchInto(minKey, maxKey, out);
+    }
+
+    scheduleMergeAdaptiveLog();
+}
+
+void DBAdaptiveMergingIndex::getAllRecordsInto(DBRecordSet& out) noexcept(true)
+{
+    std::shared_lock<std::shared_mutex> lock(mergeMutex);
+    do_getAllRecordsInto(out);
+}
+
+std::unique_ptr<DBIndexCursor> DBAdaptiveMergingIndex::newCursor() noexcept(true)
+{
+    std::shared_lock<std::shared_mutex> lock(mergeMutex);
+    return do_newCursor();
+}
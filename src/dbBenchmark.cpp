@@ -2,6 +2,10 @@
 #include <logger.hpp>
 #include <dbRecordGenerator.hpp>
 #include <host.hpp>
+#include <dbInMemoryIndex.hpp>
+#include <dbLevelDbIndex.hpp>
+#include <dbLevelDbFullScan.hpp>
+#include <dbAdaptiveMergingIndex.hpp>
 
 #include <numeric>
 #include <random>
@@ -53,7 +57,7 @@ std::vector<size_t> DBBenchmark::generateAMQueries(const size_t databaseEntries,
     return queries;
 }
 
-void DBBenchmark::leveldbBenchmarkPut(const std::vector<DBRecord>& entries, const size_t millisecondsSleep, const bool flushFileSystemBuffer) noexcept(true)
+void DBBenchmark::leveldbBenchmarkPut(const std::vector<DBRecord>& entries, const size_t millisecondsSleep, const bool flushFileSystemBuffer, const DBLevelDbOptions& dbOptions) noexcept(true)
 {
     const std::string databaseFolderName = std::string(".") + hostPlatform::directorySeparator + std::string("leveldb_benchmark_put");
     std::cout << std::unitbuf;
@@ -67,8 +71,9 @@ void DBBenchmark::leveldbBenchmarkPut(const std::vector<DBRecord>& entries, cons
 
     // open DB
     leveldb::DB* db;
-    leveldb::Options options;
-    options.create_if_missing = true;
+    std::unique_ptr<leveldb::Cache> blockCache;
+    std::unique_ptr<const leveldb::FilterPolicy> filterPolicy;
+    const leveldb::Options options = dbOptions.toLevelDbOptions(blockCache, filterPolicy);
 
     const leveldb::Status status = leveldb::DB::Open(options, databaseFolderName, &db);
 
@@ -98,7 +103,7 @@ void DBBenchmark::leveldbBenchmarkPut(const std::vector<DBRecord>& entries, cons
     std::cout << "LEVELDB BENCHMARK PUT (sleep " << millisecondsSleep << " ms ) took " << std::chrono::duration_cast<std::chrono::milliseconds>(endWrite - startWrite).count() << " ms" << std::endl;
 }
 
-void DBBenchmark::leveldbBenchmarkWritebatch(const std::vector<DBRecord>& entries, const size_t batchSize, const size_t millisecondsSleep, const bool flushFileSystemBuffer) noexcept(true)
+void DBBenchmark::leveldbBenchmarkWritebatch(const std::vector<DBRecord>& entries, const size_t batchSize, const size_t millisecondsSleep, const bool flushFileSystemBuffer, const DBLevelDbOptions& dbOptions) noexcept(true)
 {
     const std::string databaseFolderName = std::string(".") + hostPlatform::directorySeparator + std::string("leveldb_benchmark_writebatch_") + std::to_string(batchSize) + std::string("_") + std::to_string(millisecondsSleep);
 
@@ -111,8 +116,9 @@ void DBBenchmark::leveldbBenchmarkWritebatch(const std::vector<DBRecord>& entrie
         hostPlatform::flushFileSystemCache();
 
     leveldb::DB* db;
-    leveldb::Options options;
-    options.create_if_missing = true;
+    std::unique_ptr<leveldb::Cache> blockCache;
+    std::unique_ptr<const leveldb::FilterPolicy> filterPolicy;
+    const leveldb::Options options = dbOptions.toLevelDbOptions(blockCache, filterPolicy);
 
     // opne DB
     const leveldb::Status status = leveldb::DB::Open(options, databaseFolderName, &db);
@@ -165,7 +171,7 @@ void DBBenchmark::leveldbBenchmarkWritebatch(const std::vector<DBRecord>& entrie
     std::cout << "LEVELDB BENCHMARK WRITEBATCH (batch size : " << batchSize <<  " sleep " << millisecondsSleep << " ms) took " << std::chrono::duration_cast<std::chrono::milliseconds>(endWrite - startWrite).count() << " ms" << std::endl;
 }
 
-void DBBenchmark::leveldbBenchmarkAMSimulation(const std::vector<DBRecord>& entries, const double sel, const size_t millisecondsSleep, const bool flushFileSystemBuffer) noexcept(true)
+void DBBenchmark::leveldbBenchmarkAMSimulation(const std::vector<DBRecord>& entries, const double sel, const size_t millisecondsSleep, const bool flushFileSystemBuffer, const DBLevelDbOptions& dbOptions) noexcept(true)
 {
     const std::string databaseFolderName = std::string(".") + hostPlatform::directorySeparator + std::string("leveldb_benchmark_am_simulation_") + std::to_string(static_cast<size_t>(sel * 100)) + std::string("_") + std::to_string(millisecondsSleep);
 
@@ -178,8 +184,9 @@ void DBBenchmark::leveldbBenchmarkAMSimulation(const std::vector<DBRecord>& entr
         hostPlatform::flushFileSystemCache();
 
     leveldb::DB* db;
-    leveldb::Options options;
-    options.create_if_missing = true;
+    std::unique_ptr<leveldb::Cache> blockCache;
+    std::unique_ptr<const leveldb::FilterPolicy> filterPolicy;
+    const leveldb::Options options = dbOptions.toLevelDbOptions(blockCache, filterPolicy);
 
     const leveldb::Status status = leveldb::DB::Open(options, databaseFolderName, &db);
 
@@ -231,7 +238,7 @@ void DBBenchmark::leveldbBenchmarkAMSimulation(const std::vector<DBRecord>& entr
     std::cout << "LEVELDB BENCHMARK AM SIMULATION (sel : " << static_cast<size_t>(sel * 100) <<  " sleep " << millisecondsSleep << " ms) took " << std::chrono::duration_cast<std::chrono::milliseconds>(endWrite - startWrite).count() << " ms" << std::endl;
 }
 
-void DBBenchmark::leveldbBenchmarkAMSimulationWithWriteBuffer(const std::vector<DBRecord>& entries, const size_t bufferSize, const double sel, const size_t millisecondsSleep, const bool flushFileSystemBuffer) noexcept(true)
+void DBBenchmark::leveldbBenchmarkAMSimulationWithWriteBuffer(const std::vector<DBRecord>& entries, const size_t bufferSize, const double sel, const size_t millisecondsSleep, const bool flushFileSystemBuffer, const DBLevelDbOptions& dbOptions) noexcept(true)
 {
     const std::string databaseFolderName = std::string(".") + hostPlatform::directorySeparator + std::string("leveldb_benchmark_am_simulation_writebuffer_") + std::to_string(bufferSize) + std::string("_") + std::to_string(static_cast<size_t>(sel * 100)) + std::string("_") + std::to_string(millisecondsSleep);
 
@@ -244,8 +251,9 @@ void DBBenchmark::leveldbBenchmarkAMSimulationWithWriteBuffer(const std::vector<
         hostPlatform::flushFileSystemCache();
 
     leveldb::DB* db;
-    leveldb::Options options;
-    options.create_if_missing = true;
+    std::unique_ptr<leveldb::Cache> blockCache;
+    std::unique_ptr<const leveldb::FilterPolicy> filterPolicy;
+    const leveldb::Options options = dbOptions.toLevelDbOptions(blockCache, filterPolicy);
 
     const leveldb::Status status = leveldb::DB::Open(options, databaseFolderName, &db);
 
@@ -378,3 +386,147 @@ void DBBenchmark::leveldbBenchmark() noexcept(true)
     DBBenchmark::leveldbBenchmarkAMSimulationWithWriteBuffer(entries, bufferSize, 0.15, 500);
     DBBenchmark::leveldbBenchmarkAMSimulationWithWriteBuffer(entries, bufferSize, 0.2, 500);
 }
+
+bool DBBenchmark::sameRecords(const std::string& indexName, const std::string& query, std::vector<DBRecord> expected, std::vector<DBRecord> found) noexcept(true)
+{
+    std::sort(std::begin(expected), std::end(expected));
+    std::sort(std::begin(found), std::end(found));
+
+    bool same = expected.size() == found.size();
+    for (size_t i = 0; same && i < expected.size(); ++i)
+        same = expected[i].getKey() == found[i].getKey() && expected[i].getVal() == found[i].getVal();
+
+    if (!same)
+        LOGGER_LOG_ERROR("{}: {} found {} records, expected {}", indexName, query, found.size(), expected.size());
+
+    return same;
+}
+
+bool DBBenchmark::indexesResultsCheck(const size_t numEntries, const size_t valSize, const size_t numQueries, const bool asyncMerge) noexcept(true)
+{
+    const std::string amFolderName = std::string(".") + hostPlatform::directorySeparator + std::string("am_check");
+    const std::string fullScanFolderName = std::string(".") + hostPlatform::directorySeparator + std::string("fullscan_check");
+    // small buffers, so records go through AL files, merges and secondaryIndex flushes
+    constexpr size_t bufferCapacity = 64;
+    constexpr size_t amBufferCapacity = 16;
+
+    std::cout << std::unitbuf;
+    std::cout << "INDEXES RESULTS CHECK (entries " << numEntries << ", queries " << numQueries << ", asyncMerge " << asyncMerge << ") ..." << std::endl;
+
+    auto removeFolders = [&amFolderName, &fullScanFolderName]()
+    {
+        std::filesystem::remove_all(amFolderName);
+        std::filesystem::remove_all(amFolderName + std::string("_secIndex"));
+        std::filesystem::remove_all(amFolderName + std::string("_al"));
+        std::filesystem::remove_all(fullScanFolderName);
+    };
+
+    removeFolders();
+
+    // DBInMemoryIndex and AM keep records by secondary key, full scan keeps records by primary key
+    auto toSecondaryKeyRecords = [](std::vector<DBRecord> records)
+    {
+        for (auto& r : records)
+            r.swapPrimaryKeyWithSecondaryKey();
+
+        return records;
+    };
+
+    // records above numEntries are inserted after the first queries
+    const size_t newEntries = std::max(static_cast<size_t>(1), numEntries / 8);
+    std::vector<DBRecord> records = DBRecordGenerator::generateRecords(numEntries + newEntries, valSize);
+    const std::vector<DBRecord> newRecords(std::begin(records) + static_cast<long>(numEntries), std::end(records));
+    records.resize(numEntries);
+
+    std::vector<DBRecord> recordsWithSecKey = toSecondaryKeyRecords(records);
+
+    std::shared_ptr<DBLevelDbIndex> primaryIndex = std::make_shared<DBLevelDbIndex>(amFolderName, bufferCapacity);
+    DBLevelDbFullScan fullScanIndex(fullScanFolderName, bufferCapacity);
+    DBInMemoryIndex ramIndex;
+
+    for (size_t i = 0; i < records.size(); ++i)
+    {
+        primaryIndex->insertRecord(records[i]);
+        fullScanIndex.insertRecord(records[i]);
+        ramIndex.insertRecord(recordsWithSecKey[i]);
+    }
+
+    primaryIndex->flushToSSTables();
+
+    bool ok = true;
+    {
+        DBAdaptiveMergingIndex amIndex(primaryIndex, bufferCapacity, amBufferCapacity, 0.5, asyncMerge);
+
+        std::random_device rd;
+        std::mt19937 gen(rd());
+        std::uniform_int_distribution<size_t> keyDistr(0, recordsWithSecKey.size() - 1);
+
+        auto checkQueries = [&]()
+        {
+            for (size_t q = 0; q < numQueries; ++q)
+            {
+                const std::string key = recordsWithSecKey[keyDistr(gen)].getKey().ToString();
+                const std::string query = std::string("psearch ") + key;
+                const std::vector<DBRecord> expected = ramIndex.psearch(key);
+                ok &= sameRecords("AM", query, expected, amIndex.psearch(key));
+                ok &= sameRecords("FullScan", query, expected, toSecondaryKeyRecords(fullScanIndex.psearch(key)));
+
+                std::string minKey = recordsWithSecKey[keyDistr(gen)].getKey().ToString();
+                std::string maxKey = recordsWithSecKey[keyDistr(gen)].getKey().ToString();
+                if (minKey > maxKey)
+                    std::swap(minKey, maxKey);
+
+                // keys shorter than secondary keys are bounds between stored keys
+                if (q % 4 == 0)
+                    minKey = minKey.substr(0, minKey.size() / 2);
+
+                const std::string rangeQuery = std::string("rsearch ") + minKey + std::string(" ") + maxKey;
+                const std::vector<DBRecord> expectedRange = ramIndex.rsearch(minKey, maxKey);
+                ok &= sameRecords("AM", rangeQuery, expectedRange, amIndex.rsearch(minKey, maxKey));
+                ok &= sameRecords("FullScan", rangeQuery, expectedRange, toSecondaryKeyRecords(fullScanIndex.rsearch(minKey, maxKey)));
+            }
+
+            const std::string missingKey = std::string("ala");
+            ok &= sameRecords("AM", std::string("psearch ") + missingKey, std::vector<DBRecord>(), amIndex.psearch(missingKey));
+            ok &= sameRecords("FullScan", std::string("psearch ") + missingKey, std::vector<DBRecord>(), fullScanIndex.psearch(missingKey));
+
+            const std::vector<DBRecord> expectedAll = ramIndex.getAllRecords();
+            ok &= sameRecords("AM", std::string("getAllRecords"), expectedAll, amIndex.getAllRecords());
+            ok &= sameRecords("FullScan", std::string("getAllRecords"), expectedAll, toSecondaryKeyRecords(fullScanIndex.getAllRecords()));
+        };
+
+        checkQueries();
+
+        // inserts and delete of every 8th record, part of deleted records is merged already
+        for (const auto& r : newRecords)
+        {
+            DBRecord rWithSecKey(r);
+            rWithSecKey.swapPrimaryKeyWithSecondaryKey();
+
+            amIndex.insertRecord(rWithSecKey);
+            fullScanIndex.insertRecord(r);
+            ramIndex.insertRecord(rWithSecKey);
+            recordsWithSecKey.push_back(rWithSecKey);
+        }
+
+        for (size_t i = 0; i < recordsWithSecKey.size(); i += 8)
+        {
+            const std::string key = recordsWithSecKey[i].getKey().ToString();
+            amIndex.deleteRecord(key);
+            fullScanIndex.deleteRecord(key);
+            ramIndex.deleteRecord(key);
+        }
+
+        keyDistr = std::uniform_int_distribution<size_t>(0, recordsWithSecKey.size() - 1);
+        checkQueries();
+    }
+
+    removeFolders();
+
+    if (ok)
+        std::cout << "INDEXES RESULTS CHECK PASSED" << std::endl;
+    else
+        std::cerr << "INDEXES RESULTS CHECK FAILED" << std::endl;
+
+    return ok;
+}
@@ -0,0 +1,117 @@
+#include <dbCoding.hpp>
+
+#include <array>
+
+void DBCoding::encodeFixed32(char* const dst, const uint32_t val) noexcept(true)
+{
+    uint8_t* const buffer = reinterpret_cast<uint8_t*>(dst);
+    for (size_t i = 0; i < sizeof(val); ++i)
+        buffer[i] = static_cast<uint8_t>(val >> (8 * i));
+}
+
+void DBCoding::encodeFixed64(char* const dst, const uint64_t val) noexcept(true)
+{
+    uint8_t* const buffer = reinterpret_cast<uint8_t*>(dst);
+    for (size_t i = 0; i < sizeof(val); ++i)
+        buffer[i] = static_cast<uint8_t>(val >> (8 * i));
+}
+
+uint32_t DBCoding::decodeFixed32(const char* const src) noexcept(true)
+{
+    const uint8_t* const buffer = reinterpret_cast<const uint8_t*>(src);
+    uint32_t val = 0;
+    for (size_t i = 0; i < sizeof(val); ++i)
+        val |= static_cast<uint32_t>(buffer[i]) << (8 * i);
+
+    return val;
+}
+
+uint64_t DBCoding::decodeFixed64(const char* const src) noexcept(true)
+{
+    const uint8_t* const buffer = reinterpret_cast<const uint8_t*>(src);
+    uint64_t val = 0;
+    for (size_t i = 0; i < sizeof(val); ++i)
+        val |= static_cast<uint64_t>(buffer[i]) << (8 * i);
+
+    return val;
+}
+
+void DBCoding::putFixed32(std::string& dst, const uint32_t val) noexcept(true)
+{
+    char buffer[sizeof(val)];
+    encodeFixed32(buffer, val);
+    dst.append(buffer, sizeof(buffer));
+}
+
+void DBCoding::putFixed64(std::string& dst, const uint64_t val) noexcept(true)
+{
+    char buffer[sizeof(val)];
+    encodeFixed64(buffer, val);
+    dst.append(buffer, sizeof(buffer));
+}
+
+void DBCoding::putLengthPrefixedSlice(std::string& dst, const leveldb::Slice& val) noexcept(true)
+{
+    putFixed32(dst, static_cast<uint32_t>(val.size()));
+    dst.append(val.data(), val.size());
+}
+
+bool DBCoding::getFixed32(leveldb::Slice& input, uint32_t& val) noexcept(true)
+{
+    if (input.size() < sizeof(val))
+        return false;
+
+    val = decodeFixed32(input.data());
+    input.remove_prefix(sizeof(val));
+
+    return true;
+}
+
+bool DBCoding::getFixed64(leveldb::Slice& input, uint64_t& val) noexcept(true)
+{
+    if (input.size() < sizeof(val))
+        return false;
+
+    val = decodeFixed64(input.data());
+    input.remove_prefix(sizeof(val));
+
+    return true;
+}
+
+bool DBCoding::getLengthPrefixedSlice(leveldb::Slice& input, leveldb::Slice& val) noexcept(true)
+{
+    uint32_t length;
+    if (!getFixed32(input, length) || input.size() < length)
+        return false;
+
+    val = leveldb::Slice(input.data(), length);
+    input.remove_prefix(length);
+
+    return true;
+}
+
+uint32_t DBCoding::crc32c(const char* const data, const size_t length) noexcept(true)
+{
+    // reflected Castagnoli polynomial, table is built once on first use
+    static const std::array<uint32_t, 256> table = []()
+    {
+        std::array<uint32_t, 256> t{};
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            uint32_t crc = i;
+            for (size_t bit = 0; bit < 8; ++bit)
+                crc = (crc & 1) ? (crc >> 1) ^ 0x82F63B78u : crc >> 1;
+
+            t[i] = crc;
+        }
+
+        return t;
+    }();
+
+    const uint8_t* const buffer = reinterpret_cast<const uint8_t*>(data);
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < length; ++i)
+        crc = table[(crc ^ buffer[i]) & 0xFF] ^ (crc >> 8);
+
+    return crc ^ 0xFFFFFFFFu;
+}
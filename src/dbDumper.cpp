@@ -1,11 +1,18 @@
 #include <dbDumper.hpp>
+#include <dbCoding.hpp>
 #include <logger.hpp>
 #include <host.hpp>
 
+#include <leveldb/env.h>
+#include <leveldb/table.h>
+#include <leveldb/iterator.h>
+
 #include <iostream>
 #include <sstream>
 #include <iomanip>
 #include <regex>
+#include <algorithm>
+#include <memory>
 
 const std::string DBDumper::fileFormatStr = std::string(".ldb");
 
@@ -27,109 +34,212 @@ std::vector<std::string> DBDumper::stringTokenize(const std::string& str, const
     return tokens;
 }
 
-std::string DBDumper::getFileName(const std::string& baseFileName, const std::string& directoryPath) noexcept(true)
+std::string DBDumper::getFileName(const uint64_t fileNumber, const std::string& directoryPath) noexcept(true)
 {
     std::stringstream ss;
-    ss << std::setw(6) << std::setfill('0') << baseFileName;
+    ss << std::setw(6) << std::setfill('0') << fileNumber;
 
     return directoryPath + hostPlatform::directorySeparator + ss.str() + fileFormatStr;
 }
 
-std::vector<std::vector<std::string>> DBDumper::getSSTableFiles(leveldb::DB* const db, const std::string& directoryPath) noexcept(true)
+std::string DBDumper::unescapeKey(const std::string& escapedKey) noexcept(true)
+{
+    // levelDB EscapeString: printable bytes as they are, others as \xNN
+    const auto hexValue = [](const char c) -> int
+                          {
+                              if (c >= '0' && c <= '9')
+                                  return c - '0';
+
+                              if (c >= 'a' && c <= 'f')
+                                  return c - 'a' + 10;
+
+                              if (c >= 'A' && c <= 'F')
+                                  return c - 'A' + 10;
+
+                              return -1;
+                          };
+
+    std::string key;
+    key.reserve(escapedKey.size());
+    for (size_t i = 0; i < escapedKey.size(); ++i)
+    {
+        if (escapedKey[i] == '\\' && i + 3 < escapedKey.size() && escapedKey[i + 1] == 'x')
+        {
+            const int high = hexValue(escapedKey[i + 2]);
+            const int low = hexValue(escapedKey[i + 3]);
+            if (high >= 0 && low >= 0)
+            {
+                key.push_back(static_cast<char>((high << 4) | low));
+                i += 3;
+                continue;
+            }
+        }
+
+        key.push_back(escapedKey[i]);
+    }
+
+    return key;
+}
+
+std::vector<DBSSTableInfo> DBDumper::getSSTablesInfo(leveldb::DB* const db, const std::string& directoryPath) noexcept(true)
 {
     std::string property;
-    db->GetProperty("leveldb.sstables", &property);
+    if (!db->GetProperty("leveldb.sstables", &property))
+    {
+        LOGGER_LOG_ERROR("Cannot get leveldb.sstables property of {}", directoryPath);
+        return std::vector<DBSSTableInfo>();
+    }
+
     std::vector<std::string> propertyLines = DBDumper::stringTokenize(property, std::string("\n"));
 
 // --- level 0 ---
 //  241:3505428['++0EAA==' @ 932137 : 1 .. 'zzkPAA==' @ 939216 : 1]
 //  201:3505369['++0IAA==' @ 852536 : 1 .. 'zzwEAA==' @ 848587 : 1]
-//  235:3505571['++4CAA==' @ 899583 : 1 .. 'zzYBAA==' @ 909630 : 1]
-//  247:3505512['++4OAA==' @ 944859 : 1 .. 'zzkDAA==' @ 967046 : 1]
-//  228:3505400['++MIAA==' @ 889482 : 1 .. 'zzwIAA==' @ 891858 : 1]
 // --- level 1 ---
 //  199:2113137['++0BAA==' @ 778817 : 1 .. '3V4BAA==' @ 722379 : 1]
+// fileNumber:fileSize[smallest internal key .. largest internal key], internal key is 'userKey' @ sequence : type
 
-    std::vector<std::vector<std::string>> dbFilesDump;
-    std::vector<std::string> levelFilesDump;
+    static const std::regex levelRegex("^--- level ([0-9]+) ---$");
+    static const std::regex ssTableRegex("^ ([0-9]+):([0-9]+)\\['(.*)' @ [0-9]+ : [0-9]+ \\.\\. '(.*)' @ [0-9]+ : [0-9]+\\]$");
+
+    std::vector<DBSSTableInfo> ssTables;
+    int level = 0;
     for (const auto& line : propertyLines)
     {
         LOGGER_LOG_TRACE("Property line {}", line);
-        if (line[0] == '-') // change level number
-        {
-            // extract number from line: --- level 1 ---
-            // const std::string levelStr = std::regex_replace(line, std::regex("[^0-9]*([0-9]+).*"), std::string("$1"));
-            // std::stringstream sstream(levelStr);
-            // sstream >> level;
-            // std::cout << "level :" << level << std::endl;
+        if (line.empty())
+            continue;
 
-            if (levelFilesDump.size() > 0)
-            {
-                dbFilesDump.push_back(levelFilesDump);
-                levelFilesDump.clear();
-            }
-        }
-        else // ssTable line: 235:3505571['++4CAA==' @ 899583 : 1 .. 'zzYBAA==' @ 909630 : 1] | file is 000235.ldb
+        std::smatch match;
+        if (std::regex_match(line, match, levelRegex))
         {
-            const size_t fileNameStartIndex = 1; // first in the line is space: ' '
-            const size_t fileNameEndIndex = line.find_first_of(':');
-            if (fileNameEndIndex == std::string::npos)
-                continue; // not found
+            level = std::stoi(match[1].str());
+            continue;
+        }
 
-            const std::string fileName =  DBDumper::getFileName(line.substr(fileNameStartIndex, fileNameEndIndex - 1), directoryPath);
-            levelFilesDump.push_back(fileName);
+        if (!std::regex_match(line, match, ssTableRegex))
+        {
+            LOGGER_LOG_WARN("Unknown leveldb.sstables line: {}", line);
+            continue;
         }
+
+        DBSSTableInfo info;
+        info.level = level;
+        info.fileNumber = std::stoull(match[1].str());
+        info.fileSize = std::stoull(match[2].str());
+        info.filePath = DBDumper::getFileName(info.fileNumber, directoryPath);
+        info.smallestKey = DBDumper::unescapeKey(match[3].str());
+        info.largestKey = DBDumper::unescapeKey(match[4].str());
+
+        ssTables.push_back(std::move(info));
     }
 
-    return dbFilesDump;
+    return ssTables;
 }
 
-std::vector<DBRecord> DBDumper::dumpSSTable(const std::string& ssTablePath) noexcept(true)
+std::vector<std::vector<std::string>> DBDumper::getSSTableFiles(leveldb::DB* const db, const std::string& directoryPath) noexcept(true)
 {
-    DBDumper::DBDumpFileBuffer buffer;
+    const std::vector<DBSSTableInfo> ssTables = DBDumper::getSSTablesInfo(db, directoryPath);
 
-    leveldb::Status status = leveldb::DumpFile(leveldb::Env::Default(), ssTablePath, &buffer);
-    if (!status.ok())
+    std::vector<std::vector<std::string>> dbFilesDump;
+    for (const auto& ssTable : ssTables)
     {
-        std::cerr << "Cannot dump ssTable: " << ssTablePath << " status: " << status.ToString() << std::endl;
-        return std::vector<DBRecord>();
+        if (dbFilesDump.size() <= static_cast<size_t>(ssTable.level))
+            dbFilesDump.resize(static_cast<size_t>(ssTable.level) + 1);
+
+        dbFilesDump[static_cast<size_t>(ssTable.level)].push_back(ssTable.filePath);
     }
 
-    return buffer.getRecords();
+    return dbFilesDump;
 }
 
+std::vector<std::string> DBDumper::getSSTableBoundaryKeys(leveldb::DB* const db) noexcept(true)
+{
+    // only keys are needed, so path of files does not matter
+    const std::vector<DBSSTableInfo> ssTables = DBDumper::getSSTablesInfo(db, std::string());
+
+    std::vector<std::string> keys;
+    keys.reserve(ssTables.size());
+    for (const auto& ssTable : ssTables)
+        keys.push_back(ssTable.smallestKey);
+
+    std::sort(std::begin(keys), std::end(keys));
+    keys.erase(std::unique(std::begin(keys), std::end(keys)), std::end(keys));
 
-leveldb::Status DBDumper::DBDumpFileBuffer::Append(const leveldb::Slice& data)
+    return keys;
+}
+
+bool DBDumper::forEachSSTableRecord(const std::string& ssTablePath, const std::function<void(const leveldb::Slice&, const leveldb::Slice&)>& f) noexcept(true)
 {
-    //'Y+IAAA==' @ 802921 : val => 'ljkEAA==XzHHnmz2b8gc0Z3batKeTiGtl3OUZvOwSktcsO2HoWoTVOWLJOSRLGLqD02Fj8faa9UHXXAxii6XjW2sJTLnjZ6HYgLqQ5jQNtUOVY4e16t7T7L'
+    leveldb::Env* const env = leveldb::Env::Default();
 
-    const std::string line = std::string(data.ToString());
+    uint64_t fileSize;
+    leveldb::Status status = env->GetFileSize(ssTablePath, &fileSize);
+    if (!status.ok())
+    {
+        std::cerr << "Cannot get size of ssTable: " << ssTablePath << " status: " << status.ToString() << std::endl;
+        return false;
+    }
 
-    const size_t keyFirstPos = line.find_first_of('\'') + 1;
-    const size_t keyLastPos = line.substr(keyFirstPos).find_first_of('\'') - 1 + keyFirstPos;
-    const std::string key = line.substr(keyFirstPos, keyLastPos - keyFirstPos + 1);
+    leveldb::RandomAccessFile* file;
+    status = env->NewRandomAccessFile(ssTablePath, &file);
+    if (!status.ok())
+    {
+        std::cerr << "Cannot open ssTable: " << ssTablePath << " status: " << status.ToString() << std::endl;
+        return false;
+    }
 
-    const size_t valFirstPos = line.substr(keyLastPos + 2).find_first_of('\'') + 1 + keyLastPos + 2;
-    const size_t valLastPos = line.substr(valFirstPos).find_first_of('\'') - 1 + valFirstPos;
-    const std::string val = line.substr(valFirstPos, valLastPos - valFirstPos + 1);
+    const std::unique_ptr<leveldb::RandomAccessFile> fileGuard(file);
 
-    LOGGER_LOG_TRACE("Getting key: ({}) val: ({}) from SSTable data ({})", key, val, data.ToString());
-    fileRecords.push_back(DBRecord(key, val));
+    leveldb::Table* table;
+    status = leveldb::Table::Open(leveldb::Options(), file, fileSize, &table);
+    if (!status.ok())
+    {
+        std::cerr << "Cannot read ssTable: " << ssTablePath << " status: " << status.ToString() << std::endl;
+        return false;
+    }
 
-    return leveldb::Status::OK();
-}
+    const std::unique_ptr<leveldb::Table> tableGuard(table);
 
-leveldb::Status DBDumper::DBDumpFileBuffer::Close()
-{
-    return leveldb::Status::OK();
-}
+    // one pass over the file, nobody reads it again through this table
+    leveldb::ReadOptions readOptions;
+    readOptions.fill_cache = false;
 
-leveldb::Status DBDumper::DBDumpFileBuffer::Flush()
-{
-    return leveldb::Status::OK();
+    const std::unique_ptr<leveldb::Iterator> it(table->NewIterator(readOptions));
+    for (it->SeekToFirst(); it->Valid(); it->Next())
+    {
+        // SSTable key is levelDB internal key: user key | (sequence << 8 | type) fixed64
+        const leveldb::Slice internalKey = it->key();
+        if (internalKey.size() < internalKeyTagSize)
+        {
+            std::cerr << "Corrupted key in ssTable: " << ssTablePath << std::endl;
+            return false;
+        }
+
+        const uint64_t tag = DBCoding::decodeFixed64(internalKey.data() + internalKey.size() - internalKeyTagSize);
+        if ((tag & 0xff) != internalKeyTypeValue)
+            continue; // deletion marker
+
+        f(leveldb::Slice(internalKey.data(), internalKey.size() - internalKeyTagSize), it->value());
+    }
+
+    if (!it->status().ok())
+    {
+        std::cerr << "Cannot iterate ssTable: " << ssTablePath << " status: " << it->status().ToString() << std::endl;
+        return false;
+    }
+
+    return true;
 }
 
-leveldb::Status DBDumper::DBDumpFileBuffer::Sync()
+std::vector<DBRecord> DBDumper::dumpSSTable(const std::string& ssTablePath) noexcept(true)
 {
-    return leveldb::Status::OK();
-}
\ No newline at end of file
+    std::vector<DBRecord> records;
+    forEachSSTableRecord(ssTablePath, [&records](const leveldb::Slice& key, const leveldb::Slice& val)
+    {
+        LOGGER_LOG_TRACE("Getting key: ({}) val: ({}) from SSTable", key.ToString(), val.ToString());
+        records.push_back(DBRecord(key, val));
+    });
+
+    return records;
+}
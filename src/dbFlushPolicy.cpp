@@ -0,0 +1,183 @@
+#include <dbFlushPolicy.hpp>
+#include <logger.hpp>
+
+#include <algorithm>
+
+uint64_t DBFlushPolicy::getRangeSize(leveldb::DB* const db, const leveldb::Slice& minKey, const leveldb::Slice& maxKey) noexcept(true)
+{
+    const leveldb::Range range(minKey, maxKey);
+    uint64_t size = 0;
+    db->GetApproximateSizes(&range, 1, &size);
+
+    return size;
+}
+
+void DBFlushPolicy::compactRange(leveldb::DB* const db, const DBCompactionRange& range) noexcept(true)
+{
+    const leveldb::Slice minSlice(range.minKey);
+    const leveldb::Slice maxSlice(range.maxKey);
+    const uint64_t rangeSize = getRangeSize(db, minSlice, maxSlice);
+
+    const auto start = std::chrono::steady_clock::now();
+
+    db->CompactRange(&minSlice, &maxSlice);
+
+    const auto end = std::chrono::steady_clock::now();
+    const uint64_t compactionMicroseconds = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+
+    {
+        std::lock_guard<std::mutex> lock(policyMutex);
+        ++stats.compactionsNumber;
+        stats.bytesRewritten += rangeSize;
+        stats.compactionMicroseconds += compactionMicroseconds;
+    }
+
+    LOGGER_LOG_DEBUG("{} policy compacted ~{} bytes in {}us", getName(), rangeSize, compactionMicroseconds);
+}
+
+void DBFlushPolicy::afterFlush(leveldb::DB* const db, const leveldb::Slice& minKey, const leveldb::Slice& maxKey) noexcept(true)
+{
+    DBCompactionRange range;
+    bool compactNow;
+    {
+        std::lock_guard<std::mutex> lock(policyMutex);
+        ++stats.flushesNumber;
+        compactNow = do_afterFlush(db, minKey, maxKey, range);
+    }
+
+    if (compactNow)
+        compactRange(db, range);
+}
+
+void DBFlushPolicy::runDeferredCompaction(leveldb::DB* const db) noexcept(true)
+{
+    DBCompactionRange range;
+    bool compactNow;
+    {
+        std::lock_guard<std::mutex> lock(policyMutex);
+        compactNow = do_runDeferredCompaction(db, range);
+    }
+
+    if (compactNow)
+        compactRange(db, range);
+}
+
+void DBFlushPolicy::beforeClose(leveldb::DB* const db) noexcept(true)
+{
+    DBCompactionRange range;
+    bool compactNow;
+    {
+        std::lock_guard<std::mutex> lock(policyMutex);
+        compactNow = do_beforeClose(db, range);
+    }
+
+    if (compactNow)
+        compactRange(db, range);
+}
+
+DBFlushPolicyStats DBFlushPolicy::getStats() noexcept(true)
+{
+    std::lock_guard<std::mutex> lock(policyMutex);
+    return stats;
+}
+
+bool DBNoCompactionFlushPolicy::do_afterFlush(leveldb::DB* const db, const leveldb::Slice& minKey, const leveldb::Slice& maxKey, DBCompactionRange& range) noexcept(true)
+{
+    (void)db;
+    (void)minKey;
+    (void)maxKey;
+    (void)range;
+
+    return false;
+}
+
+bool DBCompactRangeFlushPolicy::do_afterFlush(leveldb::DB* const db, const leveldb::Slice& minKey, const leveldb::Slice& maxKey, DBCompactionRange& range) noexcept(true)
+{
+    (void)db;
+    range.minKey = minKey.ToString();
+    range.maxKey = maxKey.ToString();
+
+    return true;
+}
+
+void DBDeferredCompactionFlushPolicy::addPendingRange(leveldb::DB* const db, const leveldb::Slice& minKey, const leveldb::Slice& maxKey) noexcept(true)
+{
+    const auto it = pendingRanges.find(db);
+    if (it == std::end(pendingRanges))
+    {
+        pendingRanges.emplace(db, DBCompactionRange{minKey.ToString(), maxKey.ToString()});
+        return;
+    }
+
+    DBCompactionRange& range = it->second;
+    if (minKey.compare(leveldb::Slice(range.minKey)) < 0)
+        range.minKey = minKey.ToString();
+
+    if (maxKey.compare(leveldb::Slice(range.maxKey)) > 0)
+        range.maxKey = maxKey.ToString();
+}
+
+bool DBDeferredCompactionFlushPolicy::takePendingRange(leveldb::DB* const db, DBCompactionRange& range) noexcept(true)
+{
+    const auto it = pendingRanges.find(db);
+    if (it == std::end(pendingRanges))
+        return false;
+
+    range = std::move(it->second);
+    pendingRanges.erase(it);
+
+    return true;
+}
+
+bool DBDeferredCompactionFlushPolicy::do_afterFlush(leveldb::DB* const db, const leveldb::Slice& minKey, const leveldb::Slice& maxKey, DBCompactionRange& range) noexcept(true)
+{
+    (void)range;
+    addPendingRange(db, minKey, maxKey);
+
+    return false;
+}
+
+bool DBDeferredCompactionFlushPolicy::do_runDeferredCompaction(leveldb::DB* const db, DBCompactionRange& range) noexcept(true)
+{
+    return takePendingRange(db, range);
+}
+
+bool DBDeferredCompactionFlushPolicy::do_beforeClose(leveldb::DB* const db, DBCompactionRange& range) noexcept(true)
+{
+    // db pointer can be reused by the next opened db, so nothing can stay pending for it
+    return takePendingRange(db, range);
+}
+
+void DBBudgetCompactionFlushPolicy::refillBudget() noexcept(true)
+{
+    const auto now = std::chrono::steady_clock::now();
+    const double seconds = std::chrono::duration<double>(now - lastRefill).count();
+    lastRefill = now;
+
+    budget = std::min(budget + seconds * static_cast<double>(bytesPerSecond), static_cast<double>(bytesPerSecond));
+}
+
+bool DBBudgetCompactionFlushPolicy::takePendingRangeIfBudget(leveldb::DB* const db, DBCompactionRange& range) noexcept(true)
+{
+    refillBudget();
+
+    // budget in debt, wait for the next flush or idle time
+    if (!hasPendingCompaction(db) || budget < 0.0)
+        return false;
+
+    takePendingRange(db, range);
+    budget -= static_cast<double>(getRangeSize(db, leveldb::Slice(range.minKey), leveldb::Slice(range.maxKey)));
+
+    return true;
+}
+
+bool DBBudgetCompactionFlushPolicy::do_afterFlush(leveldb::DB* const db, const leveldb::Slice& minKey, const leveldb::Slice& maxKey, DBCompactionRange& range) noexcept(true)
+{
+    addPendingRange(db, minKey, maxKey);
+    return takePendingRangeIfBudget(db, range);
+}
+
+bool DBBudgetCompactionFlushPolicy::do_runDeferredCompaction(leveldb::DB* const db, DBCompactionRange& range) noexcept(true)
+{
+    return takePendingRangeIfBudget(db, range);
+}
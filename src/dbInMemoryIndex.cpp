@@ -1,43 +1,38 @@
 #include <dbInMemoryIndex.hpp>
 #include <logger.hpp>
 
-#include <iterator>
-#include <algorithm>
-
 void DBInMemoryIndex::do_insertRecord(const DBRecord& r) noexcept(true)
 {
-    index.insert({r.getKey().ToString(), r});
+    index->insert(r.getKey(), r.getVal());
 }
 
 void DBInMemoryIndex::do_deleteRecord(const std::string& key) noexcept(true)
 {
-    index.erase(key);
+    index->erase(leveldb::Slice(key));
 }
 
 std::vector<DBRecord> DBInMemoryIndex::do_psearch(const std::string& key) noexcept(true)
 {
     std::vector<DBRecord> ret;
-    const auto r = index.find(key);
 
-    if (r == index.end())
+    leveldb::Slice val;
+    if (!index->get(leveldb::Slice(key), val))
         return ret; // record not found, return empty vector
 
-    ret.push_back(r->second);
+    ret.push_back(DBRecord(leveldb::Slice(key), val));
     return ret;
 }
 
 std::vector<DBRecord> DBInMemoryIndex::do_rsearch(const std::string& minKey, const std::string& maxKey) noexcept(true)
 {
     std::vector<DBRecord> ret;
-
-    auto lowRange = index.lower_bound(minKey);
-    auto upRange = index.upper_bound(maxKey);
-
-    if (lowRange == upRange) // no value
+    if (maxKey < minKey)
         return ret;
 
-    for (auto it = lowRange; it != upRange; ++it)
-        ret.push_back(it->second);
+    const leveldb::Slice maxSlice(maxKey);
+    DBSkipList::Iterator it(index.get());
+    for (it.seek(leveldb::Slice(minKey)); it.isValid() && it.getKey().compare(maxSlice) <= 0; it.next())
+        ret.push_back(DBRecord(it.getKey(), it.getVal()));
 
     return ret;
 }
@@ -45,13 +40,37 @@ std::vector<DBRecord> DBInMemoryIndex::do_rsearch(const std::string& minKey, con
 std::vector<DBRecord> DBInMemoryIndex::do_getAllRecords() noexcept(true)
 {
     std::vector<DBRecord> ret;
-    ret.reserve(index.size());
+    ret.reserve(index->getRecordsNumber());
 
-    std::transform(std::begin(index), std::end(index), std::back_inserter(ret), [](const auto& elem) { return elem.second; });
+    DBSkipList::Iterator it(index.get());
+    for (it.seekToFirst(); it.isValid(); it.next())
+        ret.push_back(DBRecord(it.getKey(), it.getVal()));
 
     return ret;
 }
 
+void DBInMemoryIndex::do_rsearchInto(const std::string& minKey, const std::string& maxKey, DBRecordSet& out) noexcept(true)
+{
+    if (maxKey < minKey)
+        return;
+
+    const leveldb::Slice maxSlice(maxKey);
+    DBSkipList::Iterator it(index.get());
+    for (it.seek(leveldb::Slice(minKey)); it.isValid() && it.getKey().compare(maxSlice) <= 0; it.next())
+        out.append(it.getKey(), it.getVal());
+}
+
+void DBInMemoryIndex::do_getAllRecordsInto(DBRecordSet& out) noexcept(true)
+{
+    DBSkipList::Iterator it(index.get());
+    for (it.seekToFirst(); it.isValid(); it.next())
+        out.append(it.getKey(), it.getVal());
+}
+
+std::unique_ptr<DBIndexCursor> DBInMemoryIndex::do_newCursor() noexcept(true)
+{
+    return std::make_unique<DBSkipListCursor>(index);
+}
 
 void DBInMemoryIndex::insertRecord(const DBRecord& r) noexcept(true)
 {
@@ -65,20 +84,34 @@ void DBInMemoryIndex::deleteRecord(const std::string& key) noexcept(true)
     do_deleteRecord(key);
 }
 
+// readers are lock free
+
 std::vector<DBRecord> DBInMemoryIndex::psearch(const std::string& key) noexcept(true)
 {
-    std::lock_guard<std::mutex> lock(dbMutex);
     return do_psearch(key);
 }
 
 std::vector<DBRecord> DBInMemoryIndex::rsearch(const std::string& minKey, const std::string& maxKey) noexcept(true)
 {
-    std::lock_guard<std::mutex> lock(dbMutex);
     return do_rsearch(minKey, maxKey);
 }
 
 std::vector<DBRecord> DBInMemoryIndex::getAllRecords() noexcept(true)
 {
-    std::lock_guard<std::mutex> lock(dbMutex);
     return do_getAllRecords();
-}
\ No newline at end of file
+}
+
+void DBInMemoryIndex::rsearchInto(const std::string& minKey, const std::string& maxKey, DBRecordSet& out) noexcept(true)
+{
+    do_rsearchInto(minKey, maxKey, out);
+}
+
+void DBInMemoryIndex::getAllRecordsInto(DBRecordSet& out) noexcept(true)
+{
+    do_getAllRecordsInto(out);
+}
+
+std::unique_ptr<DBIndexCursor> DBInMemoryIndex::newCursor() noexcept(true)
+{
+    return do_newCursor();
+}
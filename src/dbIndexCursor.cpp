@@ -0,0 +1,49 @@
+#include <dbIndexCursor.hpp>
+
+void DBRecordSetCursor::seek(const leveldb::Slice& key) noexcept(true)
+{
+    // binary search of the first record with key >= key
+    size_t low = 0;
+    size_t high = records.size();
+    while (low < high)
+    {
+        const size_t mid = low + (high - low) / 2;
+        if (records.getKey(mid).compare(key) < 0)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    pos = low;
+}
+
+void DBMergingCursor::findSmallest() noexcept(true)
+{
+    current = nullptr;
+    for (const auto& child : children)
+        if (child->isValid() && (current == nullptr || child->getKey().compare(current->getKey()) < 0))
+            current = child.get();
+}
+
+void DBMergingCursor::seekToFirst() noexcept(true)
+{
+    for (auto& child : children)
+        child->seekToFirst();
+
+    findSmallest();
+}
+
+void DBMergingCursor::seek(const leveldb::Slice& key) noexcept(true)
+{
+    for (auto& child : children)
+        child->seek(key);
+
+    findSmallest();
+}
+
+void DBMergingCursor::next() noexcept(true)
+{
+    // all other children are already at keys >= current key
+    current->next();
+    findSmallest();
+}
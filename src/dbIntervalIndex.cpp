@@ -0,0 +1,176 @@
+#include <dbIntervalIndex.hpp>
+#include <logger.hpp>
+
+#include <utility>
+
+bool DBIntervalIndex::isLess(const std::string& minKeyA, const size_t idA, const std::string& minKeyB, const size_t idB) noexcept(true)
+{
+    const int cmp = minKeyA.compare(minKeyB);
+    return cmp < 0 || (cmp == 0 && idA < idB);
+}
+
+void DBIntervalIndex::updateSubtreeMaxKey(DBIntervalIndexNode* const node) noexcept(true)
+{
+    node->subtreeMaxKey = node->maxKey;
+    if (node->left && node->left->subtreeMaxKey > node->subtreeMaxKey)
+        node->subtreeMaxKey = node->left->subtreeMaxKey;
+
+    if (node->right && node->right->subtreeMaxKey > node->subtreeMaxKey)
+        node->subtreeMaxKey = node->right->subtreeMaxKey;
+}
+
+void DBIntervalIndex::split(std::unique_ptr<DBIntervalIndexNode> node, const std::string& minKey, const size_t id, std::unique_ptr<DBIntervalIndexNode>& less, std::unique_ptr<DBIntervalIndexNode>& greaterEqual) noexcept(true)
+{
+    if (!node)
+    {
+        less.reset();
+        greaterEqual.reset();
+        return;
+    }
+
+    if (isLess(node->minKey, node->id, minKey, id))
+    {
+        split(std::move(node->right), minKey, id, node->right, greaterEqual);
+        updateSubtreeMaxKey(node.get());
+        less = std::move(node);
+    }
+    else
+    {
+        split(std::move(node->left), minKey, id, less, node->left);
+        updateSubtreeMaxKey(node.get());
+        greaterEqual = std::move(node);
+    }
+}
+
+std::unique_ptr<DBIntervalIndex::DBIntervalIndexNode> DBIntervalIndex::merge(std::unique_ptr<DBIntervalIndexNode> less, std::unique_ptr<DBIntervalIndexNode> greater) noexcept(true)
+{
+    if (!less)
+        return greater;
+
+    if (!greater)
+        return less;
+
+    if (less->priority > greater->priority)
+    {
+        less->right = merge(std::move(less->right), std::move(greater));
+        updateSubtreeMaxKey(less.get());
+        return less;
+    }
+
+    greater->left = merge(std::move(less), std::move(greater->left));
+    updateSubtreeMaxKey(greater.get());
+    return greater;
+}
+
+void DBIntervalIndex::insertNode(std::unique_ptr<DBIntervalIndexNode>& node, std::unique_ptr<DBIntervalIndexNode> newNode) noexcept(true)
+{
+    if (!node)
+    {
+        node = std::move(newNode);
+        return;
+    }
+
+    // new node has higher priority, so it becomes root of this subtree
+    if (newNode->priority > node->priority)
+    {
+        split(std::move(node), newNode->minKey, newNode->id, newNode->left, newNode->right);
+        updateSubtreeMaxKey(newNode.get());
+        node = std::move(newNode);
+        return;
+    }
+
+    if (isLess(newNode->minKey, newNode->id, node->minKey, node->id))
+        insertNode(node->left, std::move(newNode));
+    else
+        insertNode(node->right, std::move(newNode));
+
+    updateSubtreeMaxKey(node.get());
+}
+
+void DBIntervalIndex::eraseNode(std::unique_ptr<DBIntervalIndexNode>& node, const std::string& minKey, const size_t id) noexcept(true)
+{
+    if (!node)
+        return;
+
+    if (node->id == id && node->minKey == minKey)
+    {
+        node = merge(std::move(node->left), std::move(node->right));
+        return;
+    }
+
+    if (isLess(minKey, id, node->minKey, node->id))
+        eraseNode(node->left, minKey, id);
+    else
+        eraseNode(node->right, minKey, id);
+
+    updateSubtreeMaxKey(node.get());
+}
+
+void DBIntervalIndex::queryNode(const DBIntervalIndexNode* const node, const std::string& minKey, const std::string& maxKey, std::vector<size_t>& ret) noexcept(true)
+{
+    // whole subtree ends before the range
+    if (node == nullptr || node->subtreeMaxKey < minKey)
+        return;
+
+    queryNode(node->left.get(), minKey, maxKey, ret);
+
+    // this node and the right subtree start after the range
+    if (node->minKey > maxKey)
+        return;
+
+    if (node->maxKey >= minKey)
+        ret.push_back(node->id);
+
+    queryNode(node->right.get(), minKey, maxKey, ret);
+}
+
+void DBIntervalIndex::insert(const size_t id, const std::string& minKey, const std::string& maxKey) noexcept(true)
+{
+    if (minKeys.find(id) != minKeys.end())
+    {
+        LOGGER_LOG_WARN("DBIntervalIndex: id {} already exists, updating", id);
+        update(id, minKey, maxKey);
+        return;
+    }
+
+    minKeys[id] = minKey;
+    insertNode(root, std::make_unique<DBIntervalIndexNode>(id, minKey, maxKey, static_cast<uint32_t>(priorityGenerator())));
+}
+
+void DBIntervalIndex::erase(const size_t id) noexcept(true)
+{
+    const auto it = minKeys.find(id);
+    if (it == minKeys.end())
+        return;
+
+    eraseNode(root, it->second, id);
+    minKeys.erase(it);
+}
+
+void DBIntervalIndex::update(const size_t id, const std::string& minKey, const std::string& maxKey) noexcept(true)
+{
+    erase(id);
+    insert(id, minKey, maxKey);
+}
+
+std::vector<size_t> DBIntervalIndex::query(const std::string& minKey, const std::string& maxKey) const noexcept(true)
+{
+    std::vector<size_t> ret;
+    if (minKey > maxKey)
+        return ret;
+
+    queryNode(root.get(), minKey, maxKey, ret);
+
+    return ret;
+}
+
+void DBIntervalIndex::clear() noexcept(true)
+{
+    root.reset();
+    minKeys.clear();
+}
+
+DBIntervalIndex::~DBIntervalIndex() noexcept(true)
+{
+    clear();
+}
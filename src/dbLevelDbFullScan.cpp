@@ -1,4 +1,7 @@
 #include <dbLevelDbFullScan.hpp>
+#include <dbThreadPool.hpp>
+
+#include <atomic>
 
 void DBLevelDbFullScan::do_insertRecord(const DBRecord& r) noexcept(true)
 {
@@ -6,50 +9,81 @@ void DBLevelDbFullScan::do_insertRecord(const DBRecord& r) noexcept(true)
     primaryIndex->insertRecord(r);
 }
 
+size_t DBLevelDbFullScan::getScanPartitionsNumber() noexcept(true)
+{
+    return static_cast<size_t>(dbThreadPool->threadPool.getThreadCount()) * scanPartitionsPerThread;
+}
+
 void DBLevelDbFullScan::do_deleteRecord(const std::string& key) noexcept(true)
 {
     // we need to find key in primary key for secondary key and then delete record from prim Index
-    std::vector<DBRecord> entries = primaryIndex->getAllRecords();
-    for (const auto& r : entries)
-        if (key == r.getVal().ToString().substr(0, 8))
-        {
-            primaryIndex->deleteRecord(r.getKey().ToString());
-            break;
-        }
+    // scan holds shared lock of the primary index, so delete is done after the scan
+    const std::vector<DBRecord> records = do_psearch(key);
+    if (records.size() > 0)
+        primaryIndex->deleteRecord(records[0].getKey().ToString());
 }
 
 std::vector<DBRecord> DBLevelDbFullScan::do_psearch(const std::string& key) noexcept(true)
 {
     // we need to find key in primary key for secondary key and then return record
-    std::vector<DBRecord> entries = primaryIndex->getAllRecords();
-    std::vector<DBRecord> ret;
+    const DBSecondaryKeyFilter keyFilter{leveldb::Slice(key), leveldb::Slice(key)};
+    const size_t partitions = getScanPartitionsNumber();
+    std::vector<DBRecordSet> partitionRecords(partitions);
+    // lowest partition with a match (partitions when none), partition stops only when a lower one has matched,
+    // so the lowest matching partition always finds its first match
+    std::atomic<size_t> matchedPartition{partitions};
 
-    for (const auto& r : entries)
-        if (key == r.getVal().ToString().substr(0, 8))
+    primaryIndex->forEachRecordParallel(partitions, [&keyFilter, &partitionRecords, &matchedPartition](size_t partition, const leveldb::Slice& rKey, const leveldb::Slice& rVal) -> bool
+                                        {
+                                            // record found in earlier partition, ours would not be returned
+                                            if (matchedPartition.load(std::memory_order_relaxed) < partition)
+                                                return false;
+
+                                            if (!keyFilter.matches(getSecondaryKey(rVal)))
+                                                return true;
+
+                                            partitionRecords[partition].append(rKey, rVal);
+
+                                            size_t matched = matchedPartition.load(std::memory_order_relaxed);
+                                            while (partition < matched && !matchedPartition.compare_exchange_weak(matched, partition, std::memory_order_relaxed))
+                                                ;
+
+                                            return false;
+                                        });
+
+    // first record of the lowest matching partition is the first record in scan order, like in the serial scan
+    std::vector<DBRecord> ret;
+    for (const auto& records : partitionRecords)
+        if (!records.empty())
         {
-            ret.push_back(r);
+            ret.push_back(records.getRecord(0));
             break;
         }
 
     return ret;
 }
 
-std::vector<DBRecord> DBLevelDbFullScan::do_rsearch(const std::string& minKey, const std::string& maxKey) noexcept(true)
+void DBLevelDbFullScan::do_rsearchInto(const std::string& minKey, const std::string& maxKey, DBRecordSet& out) noexcept(true)
 {
     if (maxKey < minKey)
-        return std::vector<DBRecord>();
+        return;
 
-    std::vector<DBRecord> entries = primaryIndex->getAllRecords();
-    std::vector<DBRecord> ret;
+    // predicate is evaluated on slices of the scan, only matching records are copied
+    // each partition has own set, so tasks do not share anything
+    const DBSecondaryKeyFilter keyFilter{leveldb::Slice(minKey), leveldb::Slice(maxKey)};
+    const size_t partitions = getScanPartitionsNumber();
+    std::vector<DBRecordSet> partitionRecords(partitions);
 
-    for (const auto& r : entries)
-    {
-        const std::string secKey = r.getVal().ToString().substr(0, 8);
-        if (secKey >= minKey && secKey <= maxKey)
-            ret.push_back(r);
-    }
+    primaryIndex->forEachRecordParallel(partitions, [&keyFilter, &partitionRecords](size_t partition, const leveldb::Slice& rKey, const leveldb::Slice& rVal) -> bool
+                                        {
+                                            if (keyFilter.matches(getSecondaryKey(rVal)))
+                                                partitionRecords[partition].append(rKey, rVal);
 
-    return ret;
+                                            return true;
+                                        });
+
+    for (auto& records : partitionRecords)
+        out.splice(std::move(records));
 }
 
 std::vector<DBRecord> DBLevelDbFullScan::do_getAllRecords() noexcept(true)
@@ -57,6 +91,11 @@ std::vector<DBRecord> DBLevelDbFullScan::do_getAllRecords() noexcept(true)
     return primaryIndex->getAllRecords();
 }
 
+std::unique_ptr<DBIndexCursor> DBLevelDbFullScan::do_newCursor() noexcept(true)
+{
+    return primaryIndex->newCursor();
+}
+
 void DBLevelDbFullScan::insertRecord(const DBRecord& r) noexcept(true)
 {
     std::lock_guard<std::mutex> lock(dbMutex);
@@ -76,13 +115,27 @@ std::vector<DBRecord> DBLevelDbFullScan::psearch(const std::string& key) noexcep
 }
 
 std::vector<DBRecord> DBLevelDbFullScan::rsearch(const std::string& minKey, const std::string& maxKey) noexcept(true)
+{
+    DBRecordSet ret;
+    rsearchInto(minKey, maxKey, ret);
+
+    return ret.toVector();
+}
+
+void DBLevelDbFullScan::rsearchInto(const std::string& minKey, const std::string& maxKey, DBRecordSet& out) noexcept(true)
 {
     std::lock_guard<std::mutex> lock(dbMutex);
-    return do_rsearch(minKey, maxKey);
+    do_rsearchInto(minKey, maxKey, out);
 }
 
 std::vector<DBRecord> DBLevelDbFullScan::getAllRecords() noexcept(true)
 {
     std::lock_guard<std::mutex> lock(dbMutex);
     return do_getAllRecords();
-}
\ No newline at end of file
+}
+
+std::unique_ptr<DBIndexCursor> DBLevelDbFullScan::newCursor() noexcept(true)
+{
+    std::lock_guard<std::mutex> lock(dbMutex);
+    return do_newCursor();
+}
@@ -1,24 +1,122 @@
 #include <dbLevelDbIndex.hpp>
 
+#include <dbDumper.hpp>
+#include <dbThreadPool.hpp>
+
 #include <leveldb/write_batch.h>
 
-void DBLevelDbIndex::do_insertRecord(const DBRecord& r) noexcept(true)
+#include <future>
+#include <algorithm>
+
+void DBLevelDbIndex::do_insertRecord(const DBRecord& r, std::unique_lock<std::shared_mutex>& lock) noexcept(true)
 {
     // no buffering
     if (inMemoryIndexCapacity == 0)
     {
+        entriesInLevelDb += countNewKeys(std::vector<leveldb::Slice>{r.getKey()});
         db->Put(leveldb::WriteOptions(), r.getKey(), r.getVal());
     }
     else
     {
         inMemoryIndex->insertRecord(r);
-        if (inMemoryIndex->getRecordsNumber() >= inMemoryIndexCapacity)
-            do_flushInMemoryIndex();
+        // deleted records still take nodes, so they count to the capacity
+        if (inMemoryIndex->getNodesNumber() >= inMemoryIndexCapacity)
+            do_scheduleFlush(lock);
     }
 }
 
-void DBLevelDbIndex::do_deleteRecord(const std::string& key) noexcept(true)
+void DBLevelDbIndex::do_insertRecords(const std::vector<DBRecord>& records, std::unique_lock<std::shared_mutex>& lock) noexcept(true)
+{
+    if (records.empty())
+        return;
+
+    // pending flush would overwrite new versions of records from the immutable buffer
+    waitForFlush(lock);
+
+    LOGGER_LOG_DEBUG("Bulk insert of {} entries to the levelDB", records.size());
+
+    const std::vector<leveldb::Slice> keys = getSortedKeys(records);
+
+    // buffered version would shadow the new one (buffer does not overwrite), so drop it
+    if (inMemoryIndex->getRecordsNumber() > 0)
+    {
+        std::vector<std::string> bufferedKeys;
+        forEachFoundKey(*inMemoryIndex->newCursor(), keys, [&bufferedKeys, &keys](size_t i) { bufferedKeys.push_back(keys[i].ToString()); });
+        for (const auto& key : bufferedKeys)
+            inMemoryIndex->deleteRecord(key);
+    }
+
+    // overwritten keys are already counted
+    const size_t newEntries = countNewKeys(keys);
+
+    leveldb::WriteBatch wb;
+    for (const auto& record : records)
+        wb.Put(record.getKey(), record.getVal());
+
+    db->Write(leveldb::WriteOptions(), &wb);
+
+    entriesInLevelDb += newEntries;
+}
+
+std::vector<leveldb::Slice> DBLevelDbIndex::getSortedKeys(const std::vector<DBRecord>& records) noexcept(true)
+{
+    std::vector<leveldb::Slice> keys;
+    keys.reserve(records.size());
+    for (const auto& record : records)
+        keys.push_back(record.getKey());
+
+    const auto lessF = [](const leveldb::Slice& a, const leveldb::Slice& b) { return a.compare(b) < 0; };
+    if (!std::is_sorted(std::begin(keys), std::end(keys), lessF))
+        std::sort(std::begin(keys), std::end(keys), lessF);
+
+    return keys;
+}
+
+void DBLevelDbIndex::forEachFoundKey(DBIndexCursor& cursor, const std::vector<leveldb::Slice>& keys, const std::function<void(size_t)>& f) noexcept(true)
+{
+    if (keys.empty())
+        return;
+
+    cursor.seek(keys.front());
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        for (size_t step = 0; cursor.isValid() && cursor.getKey().compare(keys[i]) < 0; ++step)
+        {
+            if (step == foundKeyMaxSteps)
+            {
+                cursor.seek(keys[i]);
+                break;
+            }
+
+            cursor.next();
+        }
+
+        if (!cursor.isValid())
+            return;
+
+        if (cursor.getKey() == keys[i])
+            f(i);
+    }
+}
+
+size_t DBLevelDbIndex::countNewKeys(const std::vector<leveldb::Slice>& keys) noexcept(true)
+{
+    // current levelDB state (not the flush snapshot), scan does not pollute the block cache
+    leveldb::ReadOptions readOptions;
+    readOptions.fill_cache = false;
+
+    DBLevelDbCursor cursor(db->NewIterator(readOptions));
+    size_t foundKeys = 0;
+    forEachFoundKey(cursor, keys, [&foundKeys](size_t) { ++foundKeys; });
+
+    return keys.size() - foundKeys;
+}
+
+void DBLevelDbIndex::do_deleteRecord(const std::string& key, std::unique_lock<std::shared_mutex>& lock) noexcept(true)
 {
+    // pending flush would bring the record back and readers of flushSnapshot would not see the delete, so delete after the flush
+    waitForFlush(lock);
+
     // there is no way to check if db deleted entry, so lets assume that if key is not in buffer then entry is deleted from db
     if (inMemoryIndex->psearch(key).size() == 0) // not found in buffer, delete from index
         --entriesInLevelDb;
@@ -31,9 +129,12 @@ void DBLevelDbIndex::do_deleteRecord(const std::string& key) noexcept(true)
 std::vector<DBRecord> DBLevelDbIndex::do_psearch(const std::string& key) noexcept(true)
 {
     std::vector<DBRecord> ret = inMemoryIndex->psearch(key);
+    if (immutableInMemoryIndex)
+        for (auto& r : immutableInMemoryIndex->psearch(key))
+            ret.push_back(std::move(r));
 
     std::string val;
-    leveldb::Status status = db->Get(leveldb::ReadOptions(), leveldb::Slice(key), &val);
+    leveldb::Status status = db->Get(getReadOptions(), leveldb::Slice(key), &val);
     if (status.ok())
         ret.push_back(DBRecord(key, val));
 
@@ -46,8 +147,11 @@ std::vector<DBRecord> DBLevelDbIndex::do_rsearch(const std::string& minKey, cons
         return std::vector<DBRecord>();
 
     std::vector<DBRecord> ret = inMemoryIndex->rsearch(minKey, maxKey);
+    if (immutableInMemoryIndex)
+        for (auto& r : immutableInMemoryIndex->rsearch(minKey, maxKey))
+            ret.push_back(std::move(r));
 
-    leveldb::Iterator* it = db->NewIterator(leveldb::ReadOptions());
+    leveldb::Iterator* it = db->NewIterator(getReadOptions());
     it->Seek(leveldb::Slice(minKey));
 
     while (it->Valid() && it->key().ToString() <= maxKey)
@@ -64,8 +168,11 @@ std::vector<DBRecord> DBLevelDbIndex::do_rsearch(const std::string& minKey, cons
 std::vector<DBRecord> DBLevelDbIndex::do_getAllRecords() noexcept(true)
 {
     std::vector<DBRecord> ret = inMemoryIndex->getAllRecords();
+    if (immutableInMemoryIndex)
+        for (auto& r : immutableInMemoryIndex->getAllRecords())
+            ret.push_back(std::move(r));
 
-    leveldb::Iterator* it = db->NewIterator(leveldb::ReadOptions());
+    leveldb::Iterator* it = db->NewIterator(getReadOptions());
     it->SeekToFirst();
 
     while (it->Valid())
@@ -81,70 +188,318 @@ std::vector<DBRecord> DBLevelDbIndex::do_getAllRecords() noexcept(true)
     return ret;
 }
 
-void DBLevelDbIndex::do_flushInMemoryIndex() noexcept(true)
+void DBLevelDbIndex::do_rsearchInto(const std::string& minKey, const std::string& maxKey, DBRecordSet& out) noexcept(true)
 {
-    if (inMemoryIndex->getRecordsNumber() == 0)
-    {
-        LOGGER_LOG_DEBUG("Nothing to flush, inMemorIndex is empty");
+    if (maxKey < minKey)
         return;
+
+    inMemoryIndex->rsearchInto(minKey, maxKey, out);
+    if (immutableInMemoryIndex)
+        immutableInMemoryIndex->rsearchInto(minKey, maxKey, out);
+
+    const leveldb::Slice maxSlice(maxKey);
+    leveldb::Iterator* it = db->NewIterator(getReadOptions());
+    it->Seek(leveldb::Slice(minKey));
+
+    while (it->Valid() && it->key().compare(maxSlice) <= 0)
+    {
+        out.append(it->key(), it->value());
+        it->Next();
     }
 
-    std::unique_ptr<leveldb::WriteBatch> wb = std::make_unique<leveldb::WriteBatch>();
+    delete it;
+}
 
-    LOGGER_LOG_DEBUG("Flushing {} entries from inMemoryIndex to the levelDB", inMemoryIndex->getRecordsNumber());
+void DBLevelDbIndex::do_getAllRecordsInto(DBRecordSet& out) noexcept(true)
+{
+    inMemoryIndex->getAllRecordsInto(out);
+    if (immutableInMemoryIndex)
+        immutableInMemoryIndex->getAllRecordsInto(out);
 
-    std::vector<DBRecord> records = inMemoryIndex->getAllRecords();
+    leveldb::Iterator* it = db->NewIterator(getReadOptions());
+    it->SeekToFirst();
+
+    while (it->Valid())
+    {
+        out.append(it->key(), it->value());
+        it->Next();
+    }
+
+    delete it;
+}
+
+std::unique_ptr<DBIndexCursor> DBLevelDbIndex::do_newCursor() noexcept(true)
+{
+    std::vector<std::unique_ptr<DBIndexCursor>> cursors;
+    cursors.push_back(inMemoryIndex->newCursor());
+    if (immutableInMemoryIndex)
+        cursors.push_back(immutableInMemoryIndex->newCursor());
+    cursors.push_back(std::make_unique<DBLevelDbCursor>(db->NewIterator(getReadOptions())));
+
+    return std::make_unique<DBMergingCursor>(std::move(cursors));
+}
+
+void DBLevelDbIndex::do_forEachRecord(const std::function<bool(const leveldb::Slice&, const leveldb::Slice&)>& f) noexcept(true)
+{
+    for (std::unique_ptr<DBIndexCursor> cursor = inMemoryIndex->newCursor(); cursor->isValid(); cursor->next())
+        if (!f(cursor->getKey(), cursor->getVal()))
+            return;
+
+    if (immutableInMemoryIndex)
+        for (std::unique_ptr<DBIndexCursor> cursor = immutableInMemoryIndex->newCursor(); cursor->isValid(); cursor->next())
+            if (!f(cursor->getKey(), cursor->getVal()))
+                return;
+
+    // one pass over the whole db, cache would only evict hot blocks
+    leveldb::ReadOptions readOptions = getReadOptions();
+    readOptions.fill_cache = false;
+
+    std::unique_ptr<leveldb::Iterator> it(db->NewIterator(readOptions));
+    for (it->SeekToFirst(); it->Valid(); it->Next())
+        if (!f(it->key(), it->value()))
+            return;
+}
+
+void DBLevelDbIndex::do_forEachRecordParallel(const size_t maxPartitions, const std::function<bool(size_t, const leveldb::Slice&, const leveldb::Slice&)>& f) noexcept(true)
+{
+    // pick split keys evenly from SSTable boundaries, partition p is <splitKeys[p - 1], splitKeys[p])
+    const std::vector<std::string> boundaryKeys = DBDumper::getSSTableBoundaryKeys(db);
+    std::vector<std::string> splitKeys;
+    for (size_t p = 1; p < maxPartitions && boundaryKeys.size() > 0; ++p)
+    {
+        const std::string& key = boundaryKeys[p * boundaryKeys.size() / maxPartitions];
+        if (splitKeys.empty() || splitKeys.back() < key)
+            splitKeys.push_back(key);
+    }
+
+    LOGGER_LOG_DEBUG("Parallel scan of {} with {} partitions", dbFolderPath, splitKeys.size() + 1);
+
+    // writers are blocked by our lock, so all partitions see the same db state
+    const auto scanPartitionF = [this, &splitKeys, &f](size_t partition) -> void
+                                {
+                                    if (partition == 0)
+                                    {
+                                        for (std::unique_ptr<DBIndexCursor> cursor = inMemoryIndex->newCursor(); cursor->isValid(); cursor->next())
+                                            if (!f(partition, cursor->getKey(), cursor->getVal()))
+                                                return;
+
+                                        if (immutableInMemoryIndex)
+                                            for (std::unique_ptr<DBIndexCursor> cursor = immutableInMemoryIndex->newCursor(); cursor->isValid(); cursor->next())
+                                                if (!f(partition, cursor->getKey(), cursor->getVal()))
+                                                    return;
+                                    }
+
+                                    leveldb::ReadOptions readOptions = getReadOptions();
+                                    readOptions.fill_cache = false;
+
+                                    std::unique_ptr<leveldb::Iterator> it(db->NewIterator(readOptions));
+                                    if (partition == 0)
+                                        it->SeekToFirst();
+                                    else
+                                        it->Seek(leveldb::Slice(splitKeys[partition - 1]));
+
+                                    for (; it->Valid(); it->Next())
+                                    {
+                                        if (partition < splitKeys.size() && it->key().compare(leveldb::Slice(splitKeys[partition])) >= 0)
+                                            break;
+
+                                        if (!f(partition, it->key(), it->value()))
+                                            break;
+                                    }
+                                };
+
+    DBTaskGroup tasks(dbThreadPool->threadPool);
+    for (size_t p = 0; p <= splitKeys.size(); ++p)
+        tasks.run([&scanPartitionF, p]() { scanPartitionF(p); });
+
+    tasks.wait();
+}
+
+void DBLevelDbIndex::writeRecords(const std::vector<DBRecord>& records) noexcept(true)
+{
+    std::unique_ptr<leveldb::WriteBatch> wb = std::make_unique<leveldb::WriteBatch>();
     for (const auto& record: records)
         wb->Put(record.getKey(), record.getVal());
 
     leveldb::WriteOptions writeOptions;
     db->Write(writeOptions, wb.get());
+}
+
+void DBLevelDbIndex::afterFlush(const std::vector<DBRecord>& records) noexcept(true)
+{
+    // policy decides if flushed range should be compacted
+    const DBRecord& minKey = records[0]; // inMemoryIndex is sorted
+    const DBRecord& maxKey = records[records.size() - 1]; // inMemoryIndex is sorted
+    flushPolicy->afterFlush(db, minKey.getKey(), maxKey.getKey());
+}
 
-    entriesInLevelDb += records.size();
+void DBLevelDbIndex::waitForFlush(std::unique_lock<std::shared_mutex>& lock) noexcept(true)
+{
+    flushDone.wait(lock, [this]() { return immutableInMemoryIndex == nullptr; });
+}
+
+void DBLevelDbIndex::do_scheduleFlush(std::unique_lock<std::shared_mutex>& lock) noexcept(true)
+{
+    // only one immutable buffer, inserts wait here when the previous flush is slower than filling the buffer
+    waitForFlush(lock);
+
+    // other insert could swap buffers while we were waiting
+    if (inMemoryIndex->getNodesNumber() < inMemoryIndexCapacity)
+        return;
+
+    if (inMemoryIndex->getRecordsNumber() == 0)
+    {
+        LOGGER_LOG_DEBUG("Nothing to flush, inMemorIndex has only deleted entries");
+
+        inMemoryIndex = std::make_shared<DBInMemoryIndex>();
+        return;
+    }
+
+    LOGGER_LOG_DEBUG("Flushing {} entries from inMemoryIndex to the levelDB in background", inMemoryIndex->getRecordsNumber());
+
+    immutableInMemoryIndex = inMemoryIndex;
+    inMemoryIndex = std::make_shared<DBInMemoryIndex>();
+    flushSnapshot = db->GetSnapshot();
+    ++pendingFlushTasks;
+
+    // searches read the immutable buffer and the levelDB snapshot until the buffer is dropped, flush policy does not block anybody
+    const auto flushF = [this](const std::shared_ptr<DBInMemoryIndex>& buffer) -> void
+                        {
+                            // writers of the levelDB wait for this flush, so keys are counted against the state we overwrite
+                            const std::vector<DBRecord> records = buffer->getAllRecords();
+                            const size_t newEntries = countNewKeys(getSortedKeys(records));
+                            writeRecords(records);
+
+                            // records become visible in the levelDB and disappear from the buffer at once
+                            {
+                                std::lock_guard<std::shared_mutex> lock(dbMutex);
+                                entriesInLevelDb += newEntries;
+                                immutableInMemoryIndex = nullptr;
+                                db->ReleaseSnapshot(flushSnapshot);
+                                flushSnapshot = nullptr;
+                            }
+
+                            flushDone.notify_all();
+
+                            afterFlush(records);
+
+                            // destructor waits for this before db is closed, so notify before the lock is released
+                            std::lock_guard<std::shared_mutex> lock(dbMutex);
+                            --pendingFlushTasks;
+                            flushDone.notify_all();
+                        };
+
+    const std::shared_ptr<DBInMemoryIndex> buffer = immutableInMemoryIndex;
+    dbThreadPool->threadPool.post([flushF, buffer]() { flushF(buffer); });
+}
+
+void DBLevelDbIndex::do_flushInMemoryIndex(std::unique_lock<std::shared_mutex>& lock) noexcept(true)
+{
+    // records from the immutable buffer have to be in the levelDB before ours
+    waitForFlush(lock);
+
+    if (inMemoryIndex->getRecordsNumber() == 0)
+    {
+        LOGGER_LOG_DEBUG("Nothing to flush, inMemorIndex is empty");
 
-    // since we have our buffer, lets flush memtable after moving buffer to the levelDB
-    const DBRecord minKey = records[0]; // inMemoryIndex is sorted
-    const DBRecord maxKey = records[records.size() - 1]; // inMemoryIndex is sorted
-    leveldb::Slice minSlice = minKey.getKey();
-    leveldb::Slice maxSlice = maxKey.getKey();
-    db->CompactRange(&minSlice, &maxSlice);
+        // buffer can still hold nodes of deleted records
+        if (inMemoryIndex->getNodesNumber() > 0)
+            inMemoryIndex = std::make_shared<DBInMemoryIndex>();
+
+        return;
+    }
+
+    LOGGER_LOG_DEBUG("Flushing {} entries from inMemoryIndex to the levelDB", inMemoryIndex->getRecordsNumber());
+
+    // buffer can overwrite keys already in the levelDB, they are counted once
+    std::vector<DBRecord> records = inMemoryIndex->getAllRecords();
+    entriesInLevelDb += countNewKeys(getSortedKeys(records));
+    writeRecords(records);
+
+    afterFlush(records);
 
     // reset inMemoryIndex
-    inMemoryIndex = std::make_unique<DBInMemoryIndex>();
+    inMemoryIndex = std::make_shared<DBInMemoryIndex>();
 }
 
 void DBLevelDbIndex::flushInMemoryIndex() noexcept(true)
 {
-    std::lock_guard<std::mutex> lock(dbMutex);
-    do_flushInMemoryIndex();
+    std::unique_lock<std::shared_mutex> lock(dbMutex);
+    do_flushInMemoryIndex(lock);
+}
+
+void DBLevelDbIndex::flushToSSTables() noexcept(true)
+{
+    flushInMemoryIndex();
+
+    LOGGER_LOG_DEBUG("Writing levelDB {} memtable to SSTables", dbFolderPath);
+
+    // memtable is compacted before levels, readers and writers are not blocked by our lock
+    db->CompactRange(nullptr, nullptr);
 }
 
 void DBLevelDbIndex::insertRecord(const DBRecord& r) noexcept(true)
 {
-    std::lock_guard<std::mutex> lock(dbMutex);
-    do_insertRecord(r);
+    std::unique_lock<std::shared_mutex> lock(dbMutex);
+    do_insertRecord(r, lock);
+}
+
+void DBLevelDbIndex::insertRecords(const std::vector<DBRecord>& records) noexcept(true)
+{
+    std::unique_lock<std::shared_mutex> lock(dbMutex);
+    do_insertRecords(records, lock);
 }
 
 void DBLevelDbIndex::deleteRecord(const std::string& key) noexcept(true)
 {
-    std::lock_guard<std::mutex> lock(dbMutex);
-    do_deleteRecord(key);
+    std::unique_lock<std::shared_mutex> lock(dbMutex);
+    do_deleteRecord(key, lock);
 }
 
 std::vector<DBRecord> DBLevelDbIndex::psearch(const std::string& key) noexcept(true)
 {
-    std::lock_guard<std::mutex> lock(dbMutex);
+    std::shared_lock<std::shared_mutex> lock(dbMutex);
     return do_psearch(key);
 }
 
 std::vector<DBRecord> DBLevelDbIndex::rsearch(const std::string& minKey, const std::string& maxKey) noexcept(true)
 {
-    std::lock_guard<std::mutex> lock(dbMutex);
+    std::shared_lock<std::shared_mutex> lock(dbMutex);
     return do_rsearch(minKey, maxKey);
 }
 
 std::vector<DBRecord> DBLevelDbIndex::getAllRecords() noexcept(true)
 {
-    std::lock_guard<std::mutex> lock(dbMutex);
+    std::shared_lock<std::shared_mutex> lock(dbMutex);
     return do_getAllRecords();
-}
\ No newline at end of file
+}
+
+void DBLevelDbIndex::rsearchInto(const std::string& minKey, const std::string& maxKey, DBRecordSet& out) noexcept(true)
+{
+    std::shared_lock<std::shared_mutex> lock(dbMutex);
+    do_rsearchInto(minKey, maxKey, out);
+}
+
+void DBLevelDbIndex::getAllRecordsInto(DBRecordSet& out) noexcept(true)
+{
+    std::shared_lock<std::shared_mutex> lock(dbMutex);
+    do_getAllRecordsInto(out);
+}
+
+std::unique_ptr<DBIndexCursor> DBLevelDbIndex::newCursor() noexcept(true)
+{
+    std::shared_lock<std::shared_mutex> lock(dbMutex);
+    return do_newCursor();
+}
+
+void DBLevelDbIndex::forEachRecord(const std::function<bool(const leveldb::Slice&, const leveldb::Slice&)>& f) noexcept(true)
+{
+    std::shared_lock<std::shared_mutex> lock(dbMutex);
+    do_forEachRecord(f);
+}
+
+void DBLevelDbIndex::forEachRecordParallel(const size_t maxPartitions, const std::function<bool(size_t, const leveldb::Slice&, const leveldb::Slice&)>& f) noexcept(true)
+{
+    std::shared_lock<std::shared_mutex> lock(dbMutex);
+    do_forEachRecordParallel(std::max(maxPartitions, static_cast<size_t>(1)), f);
+}
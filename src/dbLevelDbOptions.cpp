@@ -0,0 +1,35 @@
+#include <dbLevelDbOptions.hpp>
+
+leveldb::Options DBLevelDbOptions::toLevelDbOptions(std::unique_ptr<leveldb::Cache>& blockCache, std::unique_ptr<const leveldb::FilterPolicy>& filterPolicy) const noexcept(true)
+{
+    leveldb::Options options;
+    options.create_if_missing = true;
+
+    if (blockCacheSize > 0)
+    {
+        blockCache.reset(leveldb::NewLRUCache(blockCacheSize));
+        options.block_cache = blockCache.get();
+    }
+
+    if (bloomFilterBitsPerKey > 0)
+    {
+        filterPolicy.reset(leveldb::NewBloomFilterPolicy(bloomFilterBitsPerKey));
+        options.filter_policy = filterPolicy.get();
+    }
+
+    if (writeBufferSize > 0)
+        options.write_buffer_size = writeBufferSize;
+
+    if (maxFileSize > 0)
+        options.max_file_size = maxFileSize;
+
+    if (blockSize > 0)
+        options.block_size = blockSize;
+
+    if (maxOpenFiles > 0)
+        options.max_open_files = maxOpenFiles;
+
+    options.compression = compression ? leveldb::kSnappyCompression : leveldb::kNoCompression;
+
+    return options;
+}
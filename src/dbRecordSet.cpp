@@ -0,0 +1,65 @@
+#include <dbRecordSet.hpp>
+
+#include <iterator>
+#include <algorithm>
+#include <cstring>
+
+char* DBRecordSet::allocate(const size_t size) noexcept(true)
+{
+    if (chunks.empty() || chunks.back().capacity - chunks.back().used < size)
+    {
+        // oversized record gets own chunk
+        const size_t capacity = std::max(chunkSize, size);
+        chunks.push_back({std::make_unique<char[]>(capacity), capacity, 0});
+    }
+
+    DBRecordSetChunk& chunk = chunks.back();
+    char* const ptr = chunk.data.get() + chunk.used;
+    chunk.used += size;
+
+    return ptr;
+}
+
+void DBRecordSet::append(const leveldb::Slice& key, const leveldb::Slice& val) noexcept(true)
+{
+    char* const ptr = allocate(key.size() + val.size());
+    std::memcpy(ptr, key.data(), key.size());
+    std::memcpy(ptr + key.size(), val.data(), val.size());
+
+    entries.push_back({ptr, static_cast<uint32_t>(key.size()), static_cast<uint32_t>(val.size())});
+}
+
+void DBRecordSet::splice(DBRecordSet&& other) noexcept(true)
+{
+    if (this == &other || other.empty())
+        return;
+
+    // other chunks go before our last chunk, so we can still fill its free space
+    chunks.insert(chunks.empty() ? std::end(chunks) : std::prev(std::end(chunks)), std::make_move_iterator(std::begin(other.chunks)), std::make_move_iterator(std::end(other.chunks)));
+    entries.insert(std::end(entries), std::begin(other.entries), std::end(other.entries));
+
+    other.clear();
+}
+
+void DBRecordSet::clear() noexcept(true)
+{
+    chunks.clear();
+    entries.clear();
+}
+
+void DBRecordSet::forEachRecord(const std::function<void(const leveldb::Slice&, const leveldb::Slice&)>& f) const noexcept(true)
+{
+    for (size_t i = 0; i < entries.size(); ++i)
+        f(getKey(i), getVal(i));
+}
+
+std::vector<DBRecord> DBRecordSet::toVector() const noexcept(true)
+{
+    std::vector<DBRecord> ret;
+    ret.reserve(entries.size());
+
+    for (size_t i = 0; i < entries.size(); ++i)
+        ret.push_back(getRecord(i));
+
+    return ret;
+}
@@ -0,0 +1,264 @@
+#include <dbSecondaryKeyFilter.hpp>
+#include <logger.hpp>
+
+#include <limits>
+#include <cstring>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DB_SECONDARY_KEY_FILTER_X86
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    using FilterKernel = void (*)(const char* keys, size_t numKeys, uint64_t minKeyValue, uint64_t maxKeyValue, uint64_t* selection);
+
+    void filterScalar(const char* const keys, const size_t numKeys, const uint64_t minKeyValue, const uint64_t maxKeyValue, uint64_t* const selection)
+    {
+        for (size_t word = 0; word * 64 < numKeys; ++word)
+        {
+            uint64_t bits = 0;
+            const size_t wordKeys = std::min(static_cast<size_t>(64), numKeys - word * 64);
+            for (size_t i = 0; i < wordKeys; ++i)
+            {
+                const uint64_t keyValue = DBSecondaryKeyFilter::decodeKey(keys + (word * 64 + i) * DBSecondaryKeyFilter::keySize);
+                bits |= static_cast<uint64_t>(keyValue >= minKeyValue && keyValue <= maxKeyValue) << i;
+            }
+
+            selection[word] = bits;
+        }
+    }
+
+#ifdef DB_SECONDARY_KEY_FILTER_X86
+    // SIMD has only signed 64 bits compare, flipping the sign bit gives unsigned order
+
+    __attribute__((target("sse4.2"))) void filterSse42(const char* const keys, const size_t numKeys, const uint64_t minKeyValue, const uint64_t maxKeyValue, uint64_t* const selection)
+    {
+        const __m128i byteSwap = _mm_set_epi8(8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7);
+        const __m128i signBit = _mm_set1_epi64x(std::numeric_limits<int64_t>::min());
+        const __m128i minKeys = _mm_xor_si128(_mm_set1_epi64x(static_cast<int64_t>(minKeyValue)), signBit);
+        const __m128i maxKeys = _mm_xor_si128(_mm_set1_epi64x(static_cast<int64_t>(maxKeyValue)), signBit);
+
+        const size_t fullWords = numKeys / 64;
+        for (size_t word = 0; word < fullWords; ++word)
+        {
+            uint64_t bits = 0;
+            const char* const wordKeys = keys + word * 64 * DBSecondaryKeyFilter::keySize;
+            for (size_t i = 0; i < 64; i += 2)
+            {
+                __m128i k = _mm_loadu_si128(reinterpret_cast<const __m128i*>(wordKeys + i * DBSecondaryKeyFilter::keySize));
+                k = _mm_xor_si128(_mm_shuffle_epi8(k, byteSwap), signBit);
+
+                const __m128i outside = _mm_or_si128(_mm_cmpgt_epi64(minKeys, k), _mm_cmpgt_epi64(k, maxKeys));
+                const uint64_t mask = static_cast<uint64_t>(_mm_movemask_pd(_mm_castsi128_pd(outside))) ^ 0x3;
+                bits |= mask << i;
+            }
+
+            selection[word] = bits;
+        }
+
+        if (fullWords * 64 < numKeys)
+            filterScalar(keys + fullWords * 64 * DBSecondaryKeyFilter::keySize, numKeys - fullWords * 64, minKeyValue, maxKeyValue, selection + fullWords);
+    }
+
+    __attribute__((target("avx2"))) void filterAvx2(const char* const keys, const size_t numKeys, const uint64_t minKeyValue, const uint64_t maxKeyValue, uint64_t* const selection)
+    {
+        // shuffle works inside 128 bits lanes, so the same pattern swaps both lanes
+        const __m256i byteSwap = _mm256_set_epi8(8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7,
+                                                 8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7);
+        const __m256i signBit = _mm256_set1_epi64x(std::numeric_limits<int64_t>::min());
+        const __m256i minKeys = _mm256_xor_si256(_mm256_set1_epi64x(static_cast<int64_t>(minKeyValue)), signBit);
+        const __m256i maxKeys = _mm256_xor_si256(_mm256_set1_epi64x(static_cast<int64_t>(maxKeyValue)), signBit);
+
+        const size_t fullWords = numKeys / 64;
+        for (size_t word = 0; word < fullWords; ++word)
+        {
+            uint64_t bits = 0;
+            const char* const wordKeys = keys + word * 64 * DBSecondaryKeyFilter::keySize;
+            for (size_t i = 0; i < 64; i += 4)
+            {
+                __m256i k = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(wordKeys + i * DBSecondaryKeyFilter::keySize));
+                k = _mm256_xor_si256(_mm256_shuffle_epi8(k, byteSwap), signBit);
+
+                const __m256i outside = _mm256_or_si256(_mm256_cmpgt_epi64(minKeys, k), _mm256_cmpgt_epi64(k, maxKeys));
+                const uint64_t mask = static_cast<uint64_t>(_mm256_movemask_pd(_mm256_castsi256_pd(outside))) ^ 0xF;
+                bits |= mask << i;
+            }
+
+            selection[word] = bits;
+        }
+
+        if (fullWords * 64 < numKeys)
+            filterScalar(keys + fullWords * 64 * DBSecondaryKeyFilter::keySize, numKeys - fullWords * 64, minKeyValue, maxKeyValue, selection + fullWords);
+    }
+#endif
+
+    struct FilterKernelInfo
+    {
+        FilterKernel kernel;
+        const char* name;
+    };
+
+    // kernels supported by this CPU, the fastest one first
+    std::vector<FilterKernelInfo> getSupportedKernels() noexcept(true)
+    {
+        std::vector<FilterKernelInfo> kernels;
+#ifdef DB_SECONDARY_KEY_FILTER_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            kernels.push_back({filterAvx2, "avx2"});
+
+        if (__builtin_cpu_supports("sse4.2"))
+            kernels.push_back({filterSse42, "sse4.2"});
+#endif
+
+        kernels.push_back({filterScalar, "scalar"});
+
+        return kernels;
+    }
+
+    FilterKernelInfo selectKernel() noexcept(true)
+    {
+        return getSupportedKernels().front();
+    }
+
+    const FilterKernelInfo& getKernel() noexcept(true)
+    {
+        static const FilterKernelInfo kernel = selectKernel();
+        return kernel;
+    }
+
+    uint64_t decodePaddedKey(const leveldb::Slice& key) noexcept(true)
+    {
+        char paddedKey[DBSecondaryKeyFilter::keySize] = {0};
+        std::memcpy(paddedKey, key.data(), std::min(key.size(), DBSecondaryKeyFilter::keySize));
+
+        return DBSecondaryKeyFilter::decodeKey(paddedKey);
+    }
+}
+
+DBSecondaryKeyFilter::DBSecondaryKeyFilter(const leveldb::Slice& minKey, const leveldb::Slice& maxKey) noexcept(true)
+: minKey{minKey.ToString()}, maxKey{maxKey.ToString()}, minKeyValue{0}, maxKeyValue{0}, emptyRange{minKey.compare(maxKey) > 0}
+{
+    // 8 bytes key k >= minKey: shorter minKey is padded by zeros, longer minKey needs k > its 8 bytes prefix
+    minKeyValue = decodePaddedKey(minKey);
+    if (minKey.size() > keySize)
+    {
+        if (minKeyValue == std::numeric_limits<uint64_t>::max())
+            emptyRange = true;
+        else
+            ++minKeyValue;
+    }
+
+    // 8 bytes key k <= maxKey: shorter maxKey needs k < maxKey padded by zeros, longer maxKey is cut to its 8 bytes prefix
+    maxKeyValue = decodePaddedKey(maxKey);
+    if (maxKey.size() < keySize)
+    {
+        if (maxKeyValue == 0)
+            emptyRange = true;
+        else
+            --maxKeyValue;
+    }
+
+    if (minKeyValue > maxKeyValue)
+        emptyRange = true;
+}
+
+void DBSecondaryKeyFilter::filter(const char* const keys, const size_t numKeys, uint64_t* const selection) const noexcept(true)
+{
+    if (emptyRange)
+    {
+        std::memset(selection, 0, ((numKeys + 63) / 64) * sizeof(uint64_t));
+        return;
+    }
+
+    getKernel().kernel(keys, numKeys, minKeyValue, maxKeyValue, selection);
+}
+
+const char* DBSecondaryKeyFilter::getKernelName() noexcept(true)
+{
+    return getKernel().name;
+}
+
+bool DBSecondaryKeyFilter::checkKernels(const size_t rounds) noexcept(true)
+{
+    // few byte values, so keys often equal the bounds and differ only by the sign bit of a byte
+    constexpr unsigned char keyBytes[] = {0x00, 0x01, 0x41, 0x7F, 0x80, 0x81, 0xFE, 0xFF};
+    constexpr size_t maxKeys = 300;
+
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::uniform_int_distribution<size_t> byteDistr(0, sizeof(keyBytes) - 1);
+    std::uniform_int_distribution<size_t> keysDistr(0, maxKeys);
+    std::uniform_int_distribution<size_t> boundSizeDistr(0, keySize + 2);
+
+    auto randomKey = [&](const size_t size)
+    {
+        std::string key(size, 0);
+        for (auto& c : key)
+            c = static_cast<char>(keyBytes[byteDistr(gen)]);
+
+        return key;
+    };
+
+    const std::vector<FilterKernelInfo> kernels = getSupportedKernels();
+    std::vector<uint64_t> expected((maxKeys + 63) / 64);
+    std::vector<uint64_t> selection((maxKeys + 63) / 64);
+
+    bool ok = true;
+    for (size_t round = 0; round < rounds; ++round)
+    {
+        const size_t numKeys = keysDistr(gen);
+        const std::string keys = randomKey(numKeys * keySize);
+        const size_t words = (numKeys + 63) / 64;
+
+        // bounds of any size, every 4th range has bounds equal to stored keys
+        std::string minKey = randomKey(boundSizeDistr(gen));
+        std::string maxKey = randomKey(boundSizeDistr(gen));
+        if (round % 4 == 0 && numKeys > 0)
+        {
+            minKey = keys.substr(std::uniform_int_distribution<size_t>(0, numKeys - 1)(gen) * keySize, keySize);
+            maxKey = keys.substr(std::uniform_int_distribution<size_t>(0, numKeys - 1)(gen) * keySize, keySize);
+        }
+
+        if (round % 2 == 0 && minKey > maxKey)
+            std::swap(minKey, maxKey);
+
+        const DBSecondaryKeyFilter keyFilter{leveldb::Slice(minKey), leveldb::Slice(maxKey)};
+
+        // matches() is the reference for the selection
+        std::fill(std::begin(expected), std::end(expected), 0);
+        for (size_t i = 0; i < numKeys; ++i)
+            if (keyFilter.matches(leveldb::Slice(keys.data() + i * keySize, keySize)))
+                expected[i / 64] |= static_cast<uint64_t>(1) << (i % 64);
+
+        auto checkSelection = [&](const char* name)
+        {
+            if (std::equal(std::begin(selection), std::begin(selection) + static_cast<long>(words), std::begin(expected)))
+                return;
+
+            LOGGER_LOG_ERROR("DBSecondaryKeyFilter kernel {} differs from matches(), keys: {}, minKey size: {}, maxKey size: {}", name, numKeys, minKey.size(), maxKey.size());
+            ok = false;
+        };
+
+        keyFilter.filter(keys.data(), numKeys, selection.data());
+        checkSelection("filter");
+
+        // kernels see only bounds of not empty ranges
+        if (keyFilter.emptyRange)
+            continue;
+
+        for (const auto& kernel : kernels)
+        {
+            kernel.kernel(keys.data(), numKeys, keyFilter.minKeyValue, keyFilter.maxKeyValue, selection.data());
+            checkSelection(kernel.name);
+        }
+    }
+
+    LOGGER_LOG_DEBUG("DBSecondaryKeyFilter checked {} kernels in {} rounds: {}", kernels.size(), rounds, ok);
+
+    return ok;
+}
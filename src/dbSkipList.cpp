@@ -0,0 +1,209 @@
+#include <dbSkipList.hpp>
+
+#include <cstring>
+#include <new>
+#include <algorithm>
+
+char* DBSkipList::allocate(const size_t size) noexcept(true)
+{
+    // keep nodes aligned for atomics
+    const size_t alignedSize = (size + alignof(DBSkipListNode) - 1) & ~(alignof(DBSkipListNode) - 1);
+    if (alignedSize > arenaRemaining)
+    {
+        // oversized record gets own chunk
+        const size_t chunkSize = std::max(arenaChunkSize, alignedSize);
+        arenaChunks.push_back(std::make_unique<char[]>(chunkSize));
+        arenaPtr = arenaChunks.back().get();
+        arenaRemaining = chunkSize;
+        arenaMemoryUsage += chunkSize;
+    }
+
+    char* const ptr = arenaPtr;
+    arenaPtr += alignedSize;
+    arenaRemaining -= alignedSize;
+
+    return ptr;
+}
+
+const char* DBSkipList::allocateValue(const leveldb::Slice& val) noexcept(true)
+{
+    const uint32_t valSize = static_cast<uint32_t>(val.size());
+    char* const ptr = allocate(sizeof(uint32_t) + val.size());
+    std::memcpy(ptr, &valSize, sizeof(uint32_t));
+    std::memcpy(ptr + sizeof(uint32_t), val.data(), val.size());
+
+    return ptr;
+}
+
+leveldb::Slice DBSkipList::decodeValue(const char* const value) noexcept(true)
+{
+    uint32_t valSize;
+    std::memcpy(&valSize, value, sizeof(uint32_t));
+
+    return leveldb::Slice(value + sizeof(uint32_t), valSize);
+}
+
+DBSkipList::DBSkipListNode* DBSkipList::newNode(const leveldb::Slice& key, const int nodeHeight) noexcept(true)
+{
+    char* const keyData = allocate(key.size());
+    std::memcpy(keyData, key.data(), key.size());
+
+    char* const nodeData = allocate(sizeof(DBSkipListNode) + sizeof(std::atomic<DBSkipListNode*>) * static_cast<size_t>(nodeHeight - 1));
+    DBSkipListNode* const node = new (nodeData) DBSkipListNode;
+    node->key = keyData;
+    node->keySize = static_cast<uint32_t>(key.size());
+    node->value.store(nullptr, std::memory_order_relaxed);
+
+    for (int i = 0; i < nodeHeight; ++i)
+        new (&node->next[i]) std::atomic<DBSkipListNode*>(nullptr);
+
+    return node;
+}
+
+uint32_t DBSkipList::nextRandom() noexcept(true)
+{
+    // xorshift, writers are serialized so state does not need to be atomic
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+
+    return randomState;
+}
+
+int DBSkipList::randomHeight() noexcept(true)
+{
+    // node is on the next level with probability 1 / branching
+    int nodeHeight = 1;
+    while (nodeHeight < maxHeight && nextRandom() % branching == 0)
+        ++nodeHeight;
+
+    return nodeHeight;
+}
+
+DBSkipList::DBSkipListNode* DBSkipList::findGreaterOrEqual(const leveldb::Slice& key, DBSkipListNode** const prev) const noexcept(true)
+{
+    DBSkipListNode* node = head;
+    int level = height.load(std::memory_order_relaxed) - 1;
+    while (true)
+    {
+        DBSkipListNode* const nextNode = node->next[level].load(std::memory_order_acquire);
+        if (nextNode != nullptr && nextNode->getKey().compare(key) < 0)
+        {
+            node = nextNode;
+            continue;
+        }
+
+        if (prev != nullptr)
+            prev[level] = node;
+
+        if (level == 0)
+            return nextNode;
+
+        --level;
+    }
+}
+
+bool DBSkipList::insert(const leveldb::Slice& key, const leveldb::Slice& val) noexcept(true)
+{
+    DBSkipListNode* prev[maxHeight];
+    DBSkipListNode* const node = findGreaterOrEqual(key, prev);
+
+    if (node != nullptr && node->getKey() == key)
+    {
+        if (node->value.load(std::memory_order_relaxed) != nullptr)
+            return false;
+
+        // deleted record is revived with new value
+        node->value.store(allocateValue(val), std::memory_order_release);
+        recordsNumber.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    const int nodeHeight = randomHeight();
+    const int listHeight = height.load(std::memory_order_relaxed);
+    if (nodeHeight > listHeight)
+    {
+        for (int i = listHeight; i < nodeHeight; ++i)
+            prev[i] = head;
+
+        // readers seeing new height before the node just go down from the head
+        height.store(nodeHeight, std::memory_order_relaxed);
+    }
+
+    DBSkipListNode* const newListNode = newNode(key, nodeHeight);
+    newListNode->value.store(allocateValue(val), std::memory_order_relaxed);
+
+    // node is complete, publish it from the bottom level
+    for (int i = 0; i < nodeHeight; ++i)
+    {
+        newListNode->next[i].store(prev[i]->next[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        prev[i]->next[i].store(newListNode, std::memory_order_release);
+    }
+
+    recordsNumber.fetch_add(1, std::memory_order_relaxed);
+    nodesNumber.fetch_add(1, std::memory_order_relaxed);
+
+    return true;
+}
+
+bool DBSkipList::erase(const leveldb::Slice& key) noexcept(true)
+{
+    DBSkipListNode* const node = findGreaterOrEqual(key, nullptr);
+    if (node == nullptr || node->getKey() != key || node->value.load(std::memory_order_relaxed) == nullptr)
+        return false;
+
+    node->value.store(nullptr, std::memory_order_release);
+    recordsNumber.fetch_sub(1, std::memory_order_relaxed);
+
+    return true;
+}
+
+bool DBSkipList::get(const leveldb::Slice& key, leveldb::Slice& val) const noexcept(true)
+{
+    const DBSkipListNode* const node = findGreaterOrEqual(key, nullptr);
+    if (node == nullptr || node->getKey() != key)
+        return false;
+
+    const char* const value = node->value.load(std::memory_order_acquire);
+    if (value == nullptr)
+        return false;
+
+    val = decodeValue(value);
+    return true;
+}
+
+DBSkipList::DBSkipList() noexcept(true)
+: arenaPtr{nullptr}, arenaRemaining{0}, arenaMemoryUsage{0}, head{nullptr}, height{1}, randomState{0xDEADBEEF}, recordsNumber{0}, nodesNumber{0}
+{
+    head = newNode(leveldb::Slice(), maxHeight);
+}
+
+void DBSkipList::Iterator::skipDeleted() noexcept(true)
+{
+    while (node != nullptr)
+    {
+        value = node->value.load(std::memory_order_acquire);
+        if (value != nullptr)
+            return;
+
+        node = node->next[0].load(std::memory_order_acquire);
+    }
+}
+
+void DBSkipList::Iterator::seekToFirst() noexcept(true)
+{
+    node = list->head->next[0].load(std::memory_order_acquire);
+    skipDeleted();
+}
+
+void DBSkipList::Iterator::seek(const leveldb::Slice& key) noexcept(true)
+{
+    node = list->findGreaterOrEqual(key, nullptr);
+    skipDeleted();
+}
+
+void DBSkipList::Iterator::next() noexcept(true)
+{
+    node = node->next[0].load(std::memory_order_acquire);
+    skipDeleted();
+}
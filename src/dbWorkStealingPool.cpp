@@ -0,0 +1,162 @@
+#include <dbWorkStealingPool.hpp>
+
+namespace
+{
+    // pool and deque of the current thread, external threads have no pool
+    thread_local const DBWorkStealingPool* currentPool = nullptr;
+    thread_local size_t currentWorkerIndex = 0;
+}
+
+void DBWorkStealingPool::post(Task&& task) noexcept(true)
+{
+    // worker keeps own tasks, so fork / join stays on one core until somebody is idle
+    const size_t queueIndex = currentPool == this ? currentWorkerIndex : nextQueue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+
+    unfinishedTasks.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lock(queues[queueIndex]->mutex);
+        queues[queueIndex]->tasks.push_back(std::move(task));
+    }
+
+    // worker parks only after it has seen queuedTasks == 0 while being counted in parkedWorkers,
+    // so one of us sees the other one (both are seq_cst)
+    queuedTasks.fetch_add(1);
+    if (parkedWorkers.load() > 0)
+    {
+        std::lock_guard<std::mutex> lock(parkMutex);
+        parkCv.notify_one();
+    }
+}
+
+bool DBWorkStealingPool::popTask(const size_t queueIndex, Task& task) noexcept(true)
+{
+    DBWorkerQueue& queue = *queues[queueIndex];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty())
+        return false;
+
+    task = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    queuedTasks.fetch_sub(1);
+
+    return true;
+}
+
+bool DBWorkStealingPool::stealTask(const size_t thiefIndex, Task& task) noexcept(true)
+{
+    for (size_t i = 1; i <= queues.size(); ++i)
+    {
+        DBWorkerQueue& queue = *queues[(thiefIndex + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty())
+            continue;
+
+        // the oldest task, usually the biggest part of the work
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+        queuedTasks.fetch_sub(1);
+
+        return true;
+    }
+
+    return false;
+}
+
+void DBWorkStealingPool::runTask(Task& task) noexcept(true)
+{
+    task();
+    task = nullptr;
+
+    if (unfinishedTasks.fetch_sub(1) == 1)
+    {
+        std::lock_guard<std::mutex> lock(parkMutex);
+        idleCv.notify_all();
+    }
+}
+
+void DBWorkStealingPool::worker(const size_t index) noexcept(true)
+{
+    currentPool = this;
+    currentWorkerIndex = index;
+
+    while (true)
+    {
+        Task task;
+        if (popTask(index, task) || stealTask(index, task))
+        {
+            runTask(task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(parkMutex);
+        parkedWorkers.fetch_add(1);
+        parkCv.wait(lock, [this]() { return queuedTasks.load() > 0 || !running.load(); });
+        parkedWorkers.fetch_sub(1);
+
+        if (!running.load() && queuedTasks.load() == 0)
+            return;
+    }
+}
+
+void DBWorkStealingPool::waitForTasks() noexcept(true)
+{
+    std::unique_lock<std::mutex> lock(parkMutex);
+    idleCv.wait(lock, [this]() { return unfinishedTasks.load() == 0; });
+}
+
+DBWorkStealingPool::DBWorkStealingPool(const size_t threads) noexcept(true)
+: nextQueue{0}, queuedTasks{0}, unfinishedTasks{0}, parkedWorkers{0}, running{true}
+{
+    const size_t threadsNumber = threads > 0 ? threads : std::max(std::thread::hardware_concurrency(), 1u);
+
+    for (size_t i = 0; i < threadsNumber; ++i)
+        queues.push_back(std::make_unique<DBWorkerQueue>());
+
+    for (size_t i = 0; i < threadsNumber; ++i)
+        workers.emplace_back(&DBWorkStealingPool::worker, this, i);
+}
+
+DBWorkStealingPool::~DBWorkStealingPool() noexcept(true)
+{
+    waitForTasks();
+
+    {
+        std::lock_guard<std::mutex> lock(parkMutex);
+        running.store(false);
+    }
+    parkCv.notify_all();
+
+    for (auto& w : workers)
+        w.join();
+}
+
+bool DBTaskGroup::DBTaskGroupState::runTask() noexcept(true)
+{
+    DBWorkStealingPool::Task task;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (tasks.empty())
+            return false;
+
+        task = std::move(tasks.front());
+        tasks.pop_front();
+    }
+
+    task();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (--pendingTasks == 0)
+        cv.notify_all();
+
+    return true;
+}
+
+void DBTaskGroup::wait() noexcept(true)
+{
+    // caller would only block, so it runs tasks which are still queued behind busy workers
+    while (state->runTask())
+        ;
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->cv.wait(lock, [this]() { return state->pendingTasks == 0; });
+}
@@ -25,12 +25,9 @@ void DBWriteBuffer::do_flush() noexcept(true)
     leveldb::WriteOptions writeOptions;
     db->Write(writeOptions, wb.get());
 
-    // since we have our buffer, lets flush memtable after moving buffer to the levelDB
-    const DBRecord minKey = *std::min_element(std::begin(recordsBuffer), std::end(recordsBuffer));
-    const DBRecord maxKey = *std::max_element(std::begin(recordsBuffer), std::end(recordsBuffer));
-    leveldb::Slice minSlice = minKey.getKey();
-    leveldb::Slice maxSlice = maxKey.getKey();
-    db->CompactRange(&minSlice, &maxSlice);
+    // policy decides if flushed range should be compacted
+    const auto minMax = std::minmax_element(std::begin(recordsBuffer), std::end(recordsBuffer));
+    flushPolicy->afterFlush(db, minMax.first->getKey(), minMax.second->getKey());
 
     recordsBuffer.clear();
     recordsBuffer.reserve(capacity);
@@ -8,6 +8,9 @@
 #ifdef __linux__
 
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #elif _WIN32
 
@@ -42,6 +45,77 @@ void flushFileSystemCache()
     std::this_thread::sleep_for(std::chrono::seconds(10));
 }
 
+const char* mapFile(const std::string& filePath, size_t& fileSize)
+{
+    const int fd = open(filePath.c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0)
+    {
+        close(fd);
+        return nullptr;
+    }
+
+    fileSize = static_cast<size_t>(fileStat.st_size);
+    void* const data = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    // mapping keeps its own reference to the file
+    close(fd);
+
+    if (data == MAP_FAILED)
+        return nullptr;
+
+    LOGGER_LOG_TRACE("File {} mapped, size: {}", filePath, fileSize);
+
+    return static_cast<const char*>(data);
+}
+
+void unmapFile(const char* const data, const size_t fileSize)
+{
+    munmap(const_cast<char*>(data), fileSize);
+}
+
+bool syncPath(const std::string& path)
+{
+    // O_RDONLY works for directories as well, fsync does not need write access
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        std::cerr << "Cannot open " << path << " for sync" << std::endl;
+        return false;
+    }
+
+    const bool synced = fsync(fd) == 0;
+    close(fd);
+
+    if (!synced)
+        std::cerr << "Cannot sync " << path << std::endl;
+
+    return synced;
+}
+
+// madvise needs page aligned address
+static void adviseAccess(const char* const data, const size_t length, const int advice)
+{
+    const uintptr_t pageSize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    const uintptr_t begin = reinterpret_cast<uintptr_t>(data) & ~(pageSize - 1);
+    const uintptr_t end = reinterpret_cast<uintptr_t>(data) + length;
+
+    madvise(reinterpret_cast<void*>(begin), end - begin, advice);
+}
+
+void adviseSequentialAccess(const char* const data, const size_t length)
+{
+    adviseAccess(data, length, MADV_SEQUENTIAL);
+}
+
+void adviseRandomAccess(const char* const data, const size_t length)
+{
+    adviseAccess(data, length, MADV_RANDOM);
+}
+
 // WINDOWS platform
 #elif _WIN32
 
@@ -54,6 +128,38 @@ void flushFileSystemCache()
     //TODO
 }
 
+const char* mapFile(const std::string& filePath, size_t& fileSize)
+{
+    LOGGER_LOG_DEBUG("Mapping file {} on Windows is not implemented!", filePath);
+
+    //TODO
+    fileSize = 0;
+    return nullptr;
+}
+
+void unmapFile(const char* data, size_t fileSize)
+{
+    //TODO
+}
+
+bool syncPath(const std::string& path)
+{
+    LOGGER_LOG_DEBUG("Syncing {} on Windows is not implemented!", path);
+
+    //TODO
+    return true;
+}
+
+void adviseSequentialAccess(const char* data, size_t length)
+{
+    //TODO
+}
+
+void adviseRandomAccess(const char* data, size_t length)
+{
+    //TODO
+}
+
 #endif
 
 